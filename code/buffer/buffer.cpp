@@ -76,9 +76,9 @@ void Buffer::retrieve_until(const char* end) {
 
 /**
  * 清除所有可读缓存
+ * 只重置读写位置，读取都以可读长度为界，不需要清零整个缓存
 */
 void Buffer::retrieve_all() {
-    bzero(&buffer_[0], buffer_.size());
     read_pos_ = write_pos_ = 0;
 }
 
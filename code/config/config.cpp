@@ -0,0 +1,283 @@
+/**
+
+ * @Date    :       2021-01-07
+*/
+
+#include "config.h"
+#include <fstream>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+const char* Config::DEFAULT_PATH = "./server.conf";
+const char* Config::ENV_PREFIX = "WEBSERVER_";
+
+const Config::Option Config::OPTIONS[] = {
+    //监听与连接
+    { "port",                   TYPE_INT,    "3880",       1, 65535,        false, "监听端口" },
+    { "trig_mode",              TYPE_INT,    "3",          0, 3,            false, "0:LT+LT 1:LT+ET 2:ET+LT 3:ET+ET" },
+    { "opt_linger",             TYPE_BOOL,   "false",      0, 0,            false, "关闭连接时等待数据发送完" },
+    { "timeout_ms",             TYPE_INT,    "60000",      0, INT_MAX,      true,  "空闲连接超时，0为不超时(不能重载为0或从0重载)" },
+    { "min_timeout_ms",         TYPE_INT,    "5000",       0, INT_MAX,      true,  "连接数接近上限时的最短空闲超时" },
+    { "keepalive_max",          TYPE_INT,    "100",        0, INT_MAX,      true,  "每个长连接最多处理的请求数，0为不限" },
+    { "buffer_size",            TYPE_INT,    "1024",       1, INT_MAX,      false, "连接读写缓冲区的初始大小" },
+    { "drain_timeout_ms",       TYPE_INT,    "10000",      0, INT_MAX,      true,  "优雅退出时等待处理中请求的最长时间" },
+    //线程与队列
+    { "thread_num",             TYPE_INT,    "4",          1, 1024,         false, "工作线程数" },
+    { "worker_queue_size",      TYPE_INT,    "16384",      0, INT_MAX,      false, "工作线程任务队列上限，满时在事件循环中执行" },
+    { "reactor_cpus",           TYPE_STRING, "",           0, 0,            false, "事件循环绑定的CPU，如0-1" },
+    { "worker_cpus",            TYPE_STRING, "",           0, 0,            false, "工作线程绑定的CPU，为空且配置了reactor_cpus时用同一NUMA节点" },
+    //准入控制
+    { "max_conn",               TYPE_INT,    "0",          0, INT_MAX,      true,  "最大连接数，0为按文件描述符上限" },
+    { "max_queue",              TYPE_INT,    "4096",       0, INT_MAX,      true,  "任务队列超过时拒绝新连接，0为不检查" },
+    { "max_inflight",           TYPE_INT,    "0",          0, INT_MAX,      true,  "处理中的请求超过时拒绝新连接，0为不检查" },
+    { "max_loop_lag_ms",        TYPE_INT,    "100",        0, INT_MAX,      true,  "事件循环延迟超过时拒绝新连接，0为不检查" },
+    { "retry_after_s",          TYPE_INT,    "1",          0, 86400,        true,  "503响应的Retry-After" },
+    //日志
+    { "open_log",               TYPE_BOOL,   "true",       0, 0,            false, "开启日志" },
+    { "log_level",              TYPE_INT,    "0",          0, 3,            true,  "0:debug 1:info 2:warn 3:error" },
+    { "log_dir",                TYPE_STRING, "./log",      0, 0,            false, "日志目录" },
+    { "log_queue_size",         TYPE_INT,    "1024",       0, INT_MAX,      false, "异步日志队列长度" },
+    { "access_sample_rate",     TYPE_INT,    "1",          0, INT_MAX,      false, "访问日志每N个请求记录一个，0为关闭" },
+    { "log_rotate_max_bytes",   TYPE_INT,    "67108864",   0, INT64_MAX,    false, "单个日志文件最大字节数，0为不限" },
+    { "log_rotate_max_lines",   TYPE_INT,    "50000",      0, INT_MAX,      false, "单个日志文件最大行数，0为不限" },
+    { "log_rotate_interval_sec", TYPE_INT,   "0",          0, INT_MAX,      false, "按时间切分日志的间隔，按整点对齐，0为不按时间切分" },
+    { "log_rotate_compress",    TYPE_BOOL,   "false",      0, 0,            false, "切出的旧日志gzip压缩" },
+    { "log_rotate_max_files",   TYPE_INT,    "0",          0, INT_MAX,      false, "保留的旧日志文件个数，0为不清理" },
+    { "stats_interval_ms",      TYPE_INT,    "60000",      0, INT_MAX,      true,  "定期在日志中输出运行指标的间隔，0为只在退出时输出" },
+    //静态文件
+    { "cache_max_bytes",        TYPE_INT,    "67108864",   0, INT64_MAX,    true,  "文件缓存总大小" },
+    { "cache_max_file_size",    TYPE_INT,    "1048576",    0, INT64_MAX,    true,  "超过这个大小的文件不缓存" },
+    { "mime_file",              TYPE_STRING, "./mime.conf", 0, 0,            false, "追加的MIME类型配置" },
+    { "cache_control",          TYPE_STRING, "",           0, 0,            false, "按内容类型的Cache-Control，如text/html=no-cache;*=public, max-age=86400" },
+    //用户存储与校验
+    { "sql_host",               TYPE_STRING, "",           0, 0,            false, "MySQL地址，为空时不使用MySQL" },
+    { "sql_port",               TYPE_INT,    "3306",       1, 65535,        false, "MySQL端口" },
+    { "sql_user",               TYPE_STRING, "root",       0, 0,            false, "MySQL用户" },
+    { "sql_password",           TYPE_STRING, "",           0, 0,            false, "MySQL密码" },
+    { "db_name",                TYPE_STRING, "webserver",  0, 0,            false, "MySQL数据库" },
+    { "conn_pool_num",          TYPE_INT,    "0",          0, 1024,         false, "MySQL连接数，也是数据库线程数" },
+    { "user_db_path",           TYPE_STRING, "",           0, 0,            false, "本地用户存储文件，未配置MySQL时使用" },
+    { "max_auth_pending",       TYPE_INT,    "1024",       1, INT_MAX,      false, "排队等待校验的请求上限" },
+    { "hash_threads",           TYPE_INT,    "0",          0, 1024,         false, "密码哈希线程数，0为CPU数的一半" },
+    { "hash_queue_size",        TYPE_INT,    "256",        1, INT_MAX,      false, "排队等待哈希的任务上限，超过返回503" },
+    { "hash_cost",              TYPE_INT,    "10",         4, 31,           false, "bcrypt cost" },
+    { nullptr,                  TYPE_INT,    nullptr,      0, 0,            false, nullptr },
+};
+
+Config::Config() : path_(DEFAULT_PATH), path_required_(false), is_help_(false) {
+    for (const Option* opt = OPTIONS; opt->name; opt++) values_[opt->name] = opt->value;
+}
+
+const Config::Option* Config::find(const std::string& name) {
+    for (const Option* opt = OPTIONS; opt->name; opt++) {
+        if (name == opt->name) return opt;
+    }
+    return nullptr;
+}
+
+bool Config::is_reloadable(const std::string& name) {
+    const Option* opt = find(name);
+    return opt && opt->reloadable;
+}
+
+/**
+ * 检查并保存一个配置值，布尔值统一保存为true/false
+*/
+bool Config::set(Values& values, const std::string& name, const std::string& value, const std::string& source) {
+    const Option* opt = find(name);
+    if (!opt) {
+        error_ = source + ": unknown option '" + name + "'";
+        return false;
+    }
+    if (opt->type == TYPE_INT) {
+        char* end = nullptr;
+        errno = 0;
+        long long v = strtoll(value.c_str(), &end, 10);
+        if (value.empty() || *end != '\0' || errno == ERANGE) {
+            error_ = source + ": '" + name + "' needs an integer, got '" + value + "'";
+            return false;
+        }
+        if (v < opt->min || v > opt->max) {
+            error_ = source + ": '" + name + "' must be in [" + std::to_string(opt->min) + ", "
+                    + std::to_string(opt->max) + "], got '" + value + "'";
+            return false;
+        }
+        values[name] = value;
+    }
+    else if (opt->type == TYPE_BOOL) {
+        const char* v = value.c_str();
+        if (!strcasecmp(v, "true") || !strcasecmp(v, "yes") || !strcasecmp(v, "on") || !strcmp(v, "1")) {
+            values[name] = "true";
+        }
+        else if (!strcasecmp(v, "false") || !strcasecmp(v, "no") || !strcasecmp(v, "off") || !strcmp(v, "0")) {
+            values[name] = "false";
+        }
+        else {
+            error_ = source + ": '" + name + "' needs true or false, got '" + value + "'";
+            return false;
+        }
+    }
+    else {
+        values[name] = value;
+    }
+    return true;
+}
+
+/**
+ * 读取配置文件，未显式指定且文件不存在时跳过
+*/
+bool Config::parse_file(Values& values) {
+    std::ifstream in(path_);
+    if (!in) {
+        if (!path_required_) return true;
+        error_ = "open config file " + path_ + " error";
+        return false;
+    }
+
+    static const char* SPACES = " \t\r";
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line)) {
+        line_no++;
+        size_t begin = line.find_first_not_of(SPACES);
+        if (begin == std::string::npos || line[begin] == '#') continue;
+        size_t eq = line.find('=', begin);
+        if (eq == std::string::npos) {
+            error_ = path_ + ":" + std::to_string(line_no) + ": expected key = value";
+            return false;
+        }
+        size_t key_end = line.find_last_not_of(SPACES, eq - 1);
+        std::string key = (key_end == std::string::npos || key_end < begin) ? "" : line.substr(begin, key_end - begin + 1);
+        size_t value_begin = line.find_first_not_of(SPACES, eq + 1);
+        size_t value_end = line.find_last_not_of(SPACES);
+        std::string value = (value_begin == std::string::npos || value_begin > value_end)
+                            ? "" : line.substr(value_begin, value_end - value_begin + 1);
+        if (!set(values, key, value, path_ + ":" + std::to_string(line_no))) return false;
+    }
+    return true;
+}
+
+bool Config::parse_env(Values& values) {
+    for (const Option* opt = OPTIONS; opt->name; opt++) {
+        std::string env = ENV_PREFIX;
+        for (const char* p = opt->name; *p; p++) env += (*p >= 'a' && *p <= 'z') ? *p - 'a' + 'A' : *p;
+        const char* value = getenv(env.c_str());
+        if (value && !set(values, opt->name, value, env)) return false;
+    }
+    return true;
+}
+
+/**
+ * 按优先级合成配置
+*/
+bool Config::build(Values& values) {
+    for (const Option* opt = OPTIONS; opt->name; opt++) values[opt->name] = opt->value;
+    if (!parse_file(values) || !parse_env(values)) return false;
+    for (const auto& item : cli_) values[item.first] = item.second;
+    return true;
+}
+
+/**
+ * 解析命令行并加载配置
+*/
+bool Config::load(int argc, char** argv) {
+    const char* env_path = getenv("WEBSERVER_CONFIG");
+    if (env_path && *env_path) {
+        path_ = env_path;
+        path_required_ = true;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            is_help_ = true;
+            return false;
+        }
+        if (arg.compare(0, 2, "--") != 0 && arg != "-c") {
+            error_ = "unexpected argument '" + arg + "'";
+            return false;
+        }
+
+        std::string key, value;
+        size_t eq = arg.find('=');
+        if (arg == "-c") {
+            key = "config";
+        }
+        else {
+            key = arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+        }
+        for (char& c : key) {
+            if (c == '-') c = '_';
+        }
+        if (eq != std::string::npos && arg != "-c") {
+            value = arg.substr(eq + 1);
+        }
+        else if (i + 1 < argc) {
+            value = argv[++i];
+        }
+        else {
+            error_ = "missing value for '" + arg + "'";
+            return false;
+        }
+
+        if (key == "config") {
+            path_ = value;
+            path_required_ = true;
+        }
+        else if (!set(cli_, key, value, "command line")) {
+            return false;
+        }
+    }
+    return build(values_);
+}
+
+/**
+ * 重新读取配置文件和环境变量，返回值有变化的配置名
+*/
+bool Config::reload(std::vector<std::string>* changed) {
+    Values values;
+    if (!build(values)) return false;
+    if (changed) {
+        changed->clear();
+        for (const auto& item : values) {
+            if (values_[item.first] != item.second) changed->push_back(item.first);
+        }
+    }
+    values_.swap(values);
+    return true;
+}
+
+int64_t Config::get_int(const char* name) const {
+    auto it = values_.find(name);
+    return it == values_.end() ? 0 : strtoll(it->second.c_str(), nullptr, 10);
+}
+
+bool Config::get_bool(const char* name) const {
+    auto it = values_.find(name);
+    return it != values_.end() && it->second == "true";
+}
+
+const std::string& Config::get_string(const char* name) const {
+    static const std::string EMPTY;
+    auto it = values_.find(name);
+    return it == values_.end() ? EMPTY : it->second;
+}
+
+const char* Config::get_cstr(const char* name) const {
+    const std::string& value = get_string(name);
+    return value.empty() ? nullptr : value.c_str();
+}
+
+void Config::usage(const char* prog) {
+    printf("usage: %s [-c config_file] [--key=value ...]\n", prog);
+    printf("config file defaults to %s, environment variables are %s<KEY>\n", DEFAULT_PATH, ENV_PREFIX);
+    printf("options marked * are reloaded on SIGHUP\n\n");
+    for (const Option* opt = OPTIONS; opt->name; opt++) {
+        printf("  %c %-22s %-12s %s\n", opt->reloadable ? '*' : ' ', opt->name,
+               *opt->value ? opt->value : "\"\"", opt->desc);
+    }
+}
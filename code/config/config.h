@@ -3,3 +3,77 @@
  * @Date    :       2020-12-17
 */
 
+#ifndef __CONFIG_H_
+#define __CONFIG_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * 服务配置
+ * 优先级从低到高：内置默认值、配置文件、环境变量、命令行
+ *   配置文件：每行"key = value"，#开头为注释，路径由--config或WEBSERVER_CONFIG指定，默认./server.conf(不存在时忽略)
+ *   环境变量：WEBSERVER_加大写的配置名，如WEBSERVER_THREAD_NUM=8
+ *   命令行：--key=value或--key value
+ * 标记为可重载的配置在收到SIGHUP后重新读取配置文件和环境变量时生效，命令行的值一直保留
+ * 其余配置决定线程、队列、监听等的结构，修改后需要重启(可以用SIGUSR2热重启)
+*/
+class Config {
+public:
+    enum TYPE {
+        TYPE_INT,
+        TYPE_BOOL,
+        TYPE_STRING,
+    };
+
+    struct Option {
+        const char* name;
+        TYPE type;
+        const char* value;//默认值
+        int64_t min;//整数的取值范围，闭区间
+        int64_t max;
+        bool reloadable;
+        const char* desc;
+    };
+
+    Config();
+    ~Config() = default;
+
+    bool load(int argc, char** argv);//失败时get_error()返回原因，-h/--help时返回false且is_help()为true
+    bool reload(std::vector<std::string>* changed);//重新读取配置文件和环境变量，失败时保持原配置
+
+    int64_t get_int(const char* name) const;
+    bool get_bool(const char* name) const;
+    const std::string& get_string(const char* name) const;
+    const char* get_cstr(const char* name) const;//空字符串返回nullptr，用于可选的配置
+
+    static bool is_reloadable(const std::string& name);
+    bool is_help() const { return is_help_; }
+    const std::string& get_error() const { return error_; }
+    const std::string& get_path() const { return path_; }
+    static void usage(const char* prog);
+
+private:
+    typedef std::map<std::string, std::string> Values;
+
+    static const Option* find(const std::string& name);
+    bool set(Values& values, const std::string& name, const std::string& value, const std::string& source);
+    bool parse_file(Values& values);
+    bool parse_env(Values& values);
+    bool build(Values& values);
+
+    static const Option OPTIONS[];
+    static const char* DEFAULT_PATH;
+    static const char* ENV_PREFIX;
+
+    std::string path_;
+    bool path_required_;//显式指定的配置文件必须存在
+    bool is_help_;
+    std::string error_;
+    Values cli_;//命令行的值，重载时保留
+    Values values_;
+};
+
+#endif // !__CONFIG_H_
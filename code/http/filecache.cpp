@@ -0,0 +1,224 @@
+/**
+
+ * @Date    :       2021-01-02
+*/
+
+#include "filecache.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <zlib.h>
+#ifdef USE_BROTLI
+#include <brotli/encode.h>
+#endif
+#include "../log/log.h"
+#include "mimetype.h"
+
+FileCache::FileCache() : max_bytes_(64 << 20), max_file_size_(1 << 20), bytes_(0), hits_(0), misses_(0) {
+
+}
+
+/**
+ * 单例模式，全局实例化一个文件缓存
+*/
+FileCache* FileCache::instance() {
+    static FileCache inst;
+    return &inst;
+}
+
+/**
+ * 设置缓存大小，启动时和重载配置时调用
+ * max_bytes：缓存的总字节数上限，含压缩版本，为0时不缓存；调小时立即按LRU淘汰
+ * max_file_size：单个文件大小上限，已缓存的大文件之后不再命中，随LRU淘汰
+*/
+void FileCache::init(size_t max_bytes, size_t max_file_size) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    max_bytes_ = max_bytes;
+    max_file_size_ = max_file_size;
+    evict(0);
+}
+
+/**
+ * 启动时预先加载目录下的文件，避免第一次访问时才压缩
+ * 放不下的文件跳过，留到访问时再按LRU淘汰
+*/
+void FileCache::preload(const std::string& dir) {
+    DIR* dp = opendir(dir.c_str());
+    if (!dp) return;
+    struct dirent* ent;
+    while ((ent = readdir(dp)) != nullptr) {
+        if (ent->d_name[0] == '.') continue;
+        std::string path = dir + "/" + ent->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) < 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            preload(path);
+        }
+        else if (S_ISREG(st.st_mode) && (st.st_mode & S_IROTH)) {
+            if (get_bytes() + static_cast<size_t>(st.st_size) > max_bytes_) continue;
+            get(path, st);
+        }
+    }
+    closedir(dp);
+}
+
+/**
+ * 取文件的缓存条目，st为调用者刚取得的文件信息
+ * 文件不适合缓存或读取失败时返回空
+*/
+FileCache::EntryPtr FileCache::get(const std::string& path, const struct stat& st) {
+    if (!S_ISREG(st.st_mode) || static_cast<size_t>(st.st_size) > max_file_size_ || max_bytes_ == 0) {
+        return nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = files_.find(path);
+        if (it != files_.end()) {
+            const Entry& entry = *it->second.entry;
+            if (entry.ino == st.st_ino && entry.size == st.st_size
+                    && entry.mtime.tv_sec == st.st_mtim.tv_sec && entry.mtime.tv_nsec == st.st_mtim.tv_nsec) {
+                lru_.splice(lru_.begin(), lru_, it->second.lru);
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return it->second.entry;
+            }
+        }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+
+    //在锁外读文件和压缩，同一文件并发加载时以后完成的为准
+    EntryPtr entry = load(path, st);
+    if (entry) insert(path, entry);
+    return entry;
+}
+
+/**
+ * 读入文件内容，文本类文件生成压缩版本
+*/
+FileCache::EntryPtr FileCache::load(const std::string& path, const struct stat& st) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+
+    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+    entry->data.resize(st.st_size);
+    size_t total = 0;
+    while (total < entry->data.size()) {
+        ssize_t n = read(fd, &entry->data[total], entry->data.size() - total);
+        if (n <= 0) break;
+        total += n;
+    }
+    close(fd);
+    if (total != entry->data.size()) {//读取过程中文件被修改
+        LOG_WARN("read %s error!", path.c_str());
+        return nullptr;
+    }
+    entry->ino = st.st_ino;
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtim;
+    entry->type = MimeType::lookup(path);
+
+    if (entry->data.size() >= MIN_COMPRESS_SIZE && MimeType::is_compressible(entry->type)) {
+        //压缩后至少省下1/8才保留
+        size_t limit = entry->data.size() - entry->data.size() / 8;
+        if (!gzip_compress(entry->data, entry->gzip) || entry->gzip.size() > limit) entry->gzip.clear();
+        if (!br_compress(entry->data, entry->br) || entry->br.size() > limit) entry->br.clear();
+        LOG_DEBUG("compress %s: %d -> gzip %d, br %d", path.c_str(), static_cast<int>(entry->data.size()),
+                    static_cast<int>(entry->gzip.size()), static_cast<int>(entry->br.size()));
+    }
+    return entry;
+}
+
+/**
+ * 插入或替换条目，超出总字节数时从最久未使用的开始淘汰
+*/
+void FileCache::insert(const std::string& path, const EntryPtr& entry) {
+    size_t bytes = entry->data.size() + entry->gzip.size() + entry->br.size();
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (bytes > max_bytes_) return;
+
+    auto it = files_.find(path);
+    if (it != files_.end()) {
+        bytes_ -= it->second.bytes;
+        lru_.erase(it->second.lru);
+        files_.erase(it);
+    }
+    evict(bytes);
+    lru_.push_front(path);
+    files_[path] = { entry, lru_.begin(), bytes };
+    bytes_ += bytes;
+}
+
+/**
+ * 从最久未使用的开始淘汰，直到能再放下bytes字节，调用者持有锁
+*/
+void FileCache::evict(size_t bytes) {
+    while (bytes_ + bytes > max_bytes_ && !lru_.empty()) {
+        auto victim = files_.find(lru_.back());
+        bytes_ -= victim->second.bytes;
+        files_.erase(victim);
+        lru_.pop_back();
+    }
+}
+
+void FileCache::clear() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    files_.clear();
+    lru_.clear();
+    bytes_ = 0;
+}
+
+/**
+ * 用最高压缩级别生成gzip格式数据，只压缩一次，多花的时间值得
+*/
+bool FileCache::gzip_compress(const std::string& src, std::string& dst) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    dst.resize(deflateBound(&zs, src.size()));
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(src.data()));
+    zs.avail_in = src.size();
+    zs.next_out = reinterpret_cast<Bytef*>(&dst[0]);
+    zs.avail_out = dst.size();
+    int ret = deflate(&zs, Z_FINISH);
+    dst.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+/**
+ * 生成brotli格式数据，编译时没有开启USE_BROTLI则不生成
+ * 最高质量11比9只小几个百分点，耗时却多十倍以上，会拖慢启动预加载
+*/
+bool FileCache::br_compress(const std::string& src, std::string& dst) {
+#ifdef USE_BROTLI
+    size_t size = BrotliEncoderMaxCompressedSize(src.size());
+    if (size == 0) return false;
+    dst.resize(size);
+    if (!BrotliEncoderCompress(BR_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                src.size(), reinterpret_cast<const uint8_t*>(src.data()),
+                &size, reinterpret_cast<uint8_t*>(&dst[0]))) {
+        return false;
+    }
+    dst.resize(size);
+    return true;
+#else
+    (void)src;
+    dst.clear();
+    return false;
+#endif
+}
+
+uint64_t FileCache::get_hit_count() const {
+    return hits_.load(std::memory_order_relaxed);
+}
+
+uint64_t FileCache::get_miss_count() const {
+    return misses_.load(std::memory_order_relaxed);
+}
+
+size_t FileCache::get_bytes() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return bytes_;
+}
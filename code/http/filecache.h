@@ -0,0 +1,94 @@
+/**
+
+ * @Date    :       2021-01-02
+*/
+
+#ifndef __FILECACHE_H_
+#define __FILECACHE_H_
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <stdint.h>
+#include <sys/stat.h>
+
+/**
+ * 静态文件缓存
+ * 小文件整个读入内存，同时记下MIME类型，文本类文件同时保存压缩好的gzip(和brotli)版本，只在加载时压缩一次
+ * 按文件的inode、大小和修改时间判断是否失效，总字节数超过上限时淘汰最久未使用的文件
+ * 条目用shared_ptr持有，发送中的响应不受淘汰影响
+*/
+class FileCache {
+public:
+    enum ENCODING {
+        ENCODING_IDENTITY,
+        ENCODING_GZIP,
+        ENCODING_BR,
+    };
+
+    struct Entry {
+        std::string data;//原始内容
+        std::string gzip;//压缩后不够小时为空
+        std::string br;
+        std::string_view type;//MIME类型，指向MimeType中的只读表
+        ino_t ino;
+        off_t size;
+        struct timespec mtime;
+
+        bool compressible() const { return !gzip.empty() || !br.empty(); }
+    };
+    typedef std::shared_ptr<const Entry> EntryPtr;
+
+    static FileCache* instance();
+
+    void init(size_t max_bytes = 64 << 20, size_t max_file_size = 1 << 20);
+    void preload(const std::string& dir);
+
+    EntryPtr get(const std::string& path, const struct stat& st);
+    void clear();
+
+    uint64_t get_hit_count() const;
+    uint64_t get_miss_count() const;
+    size_t get_bytes();
+
+private:
+    FileCache();
+    ~FileCache() = default;
+
+    typedef std::list<std::string> LruList;
+
+    struct Node {
+        EntryPtr entry;
+        LruList::iterator lru;
+        size_t bytes;
+    };
+
+    EntryPtr load(const std::string& path, const struct stat& st);
+    void insert(const std::string& path, const EntryPtr& entry);
+    void evict(size_t bytes);
+
+    static bool gzip_compress(const std::string& src, std::string& dst);
+    static bool br_compress(const std::string& src, std::string& dst);
+
+private:
+    static const size_t MIN_COMPRESS_SIZE = 1024;//太小的文件压缩后省不了多少，不压缩
+    static const int BR_QUALITY = 9;
+
+    //重载配置时会修改，get在锁外读取
+    std::atomic<size_t> max_bytes_;
+    std::atomic<size_t> max_file_size_;//超过这个大小的文件不缓存，仍然映射发送
+
+    std::mutex mtx_;
+    std::unordered_map<std::string, Node> files_;
+    LruList lru_;//表头为最近使用
+    size_t bytes_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+};
+
+#endif // !__FILECACHE_H_
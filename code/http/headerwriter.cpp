@@ -0,0 +1,257 @@
+/**
+
+ * @Date    :       2021-01-04
+*/
+
+#include "headerwriter.h"
+#include <string.h>
+
+namespace {
+
+struct Status {
+    int code;
+    std::string_view line;
+    std::string_view reason;
+};
+
+const Status STATUS[] = {
+    { 200, "HTTP/1.1 200 OK\r\n", "OK" },
+    { 206, "HTTP/1.1 206 Partial Content\r\n", "Partial Content" },
+    { 304, "HTTP/1.1 304 Not Modified\r\n", "Not Modified" },
+    { 400, "HTTP/1.1 400 Bad Request\r\n", "Bad Request" },
+    { 403, "HTTP/1.1 403 Forbidden\r\n", "Forbidden" },
+    { 404, "HTTP/1.1 404 Not Found\r\n", "Not Found" },
+    { 416, "HTTP/1.1 416 Range Not Satisfiable\r\n", "Range Not Satisfiable" },
+    { 503, "HTTP/1.1 503 Service Unavailable\r\n", "Service Unavailable" },
+};
+
+const Status* find_status(int code) {
+    for (const Status& status : STATUS) {
+        if (status.code == code) return &status;
+    }
+    return nullptr;
+}
+
+const char DIGITS[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+const uint64_t POW10[20] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL,
+};
+
+const char WEEKDAY[7][4] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+const char MONTH[12][4] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec",
+};
+
+inline void put2(char* dst, int value) {
+    memcpy(dst, DIGITS + value * 2, 2);
+}
+
+/**
+ * 每个线程缓存当前秒的Date头
+*/
+struct DateCache {
+    time_t sec = -1;
+    char line[64];
+    size_t len = 0;
+};
+
+}
+
+/**
+ * 返回可写区域中未提交内容之后的位置，保证至少有len字节
+ * Buffer扩容时可能搬移数据，只保留已提交的内容，因此空间不够时先提交
+*/
+char* HeaderWriter::reserve(size_t len) {
+    if (buffer_.get_writable_bytes() < pending_ + len) {
+        commit();
+        buffer_.ensure_writeable(len);
+    }
+    return buffer_.get_begin_write_ptr() + pending_;
+}
+
+void HeaderWriter::commit() {
+    if (pending_) {
+        buffer_.has_written(pending_);
+        pending_ = 0;
+    }
+}
+
+bool HeaderWriter::status_line(int code) {
+    const Status* status = find_status(code);
+    if (!status) return false;
+    append(status->line);
+    return true;
+}
+
+/**
+ * 状态码对应的原因短语，未知的返回空
+*/
+std::string_view HeaderWriter::reason(int code) {
+    const Status* status = find_status(code);
+    return status ? status->reason : std::string_view();
+}
+
+void HeaderWriter::header(std::string_view name, std::string_view value) {
+    size_t len = name.size() + value.size() + 4;
+    char* p = reserve(len);
+    memcpy(p, name.data(), name.size());
+    p += name.size();
+    *p++ = ':';
+    *p++ = ' ';
+    memcpy(p, value.data(), value.size());
+    p += value.size();
+    *p++ = '\r';
+    *p = '\n';
+    written(len);
+}
+
+void HeaderWriter::header(std::string_view name, uint64_t value) {
+    char* begin = reserve(name.size() + 24);
+    char* p = begin;
+    memcpy(p, name.data(), name.size());
+    p += name.size();
+    *p++ = ':';
+    *p++ = ' ';
+    p += format_uint(p, value);
+    *p++ = '\r';
+    *p++ = '\n';
+    written(p - begin);
+}
+
+/**
+ * 写入Date头，同一秒内直接复制缓存的内容
+*/
+void HeaderWriter::date() {
+    static thread_local DateCache cache;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    if (now.tv_sec != cache.sec) {
+        cache.sec = now.tv_sec;
+        memcpy(cache.line, "Date: ", 6);
+        size_t len = 6 + format_http_date(cache.line + 6, now.tv_sec);
+        memcpy(cache.line + len, "\r\n", 2);
+        cache.len = len + 2;
+    }
+    append(std::string_view(cache.line, cache.len));
+}
+
+void HeaderWriter::last_modified(time_t mtime) {
+    static const std::string_view NAME = "Last-Modified: ";
+    char* begin = reserve(NAME.size() + 31);
+    memcpy(begin, NAME.data(), NAME.size());
+    char* p = begin + NAME.size();
+    p += format_http_date(p, mtime);
+    *p++ = '\r';
+    *p++ = '\n';
+    written(p - begin);
+}
+
+void HeaderWriter::content_range(uint64_t begin, uint64_t end, uint64_t size) {
+    static const std::string_view NAME = "Content-Range: bytes ";
+    char* start = reserve(NAME.size() + 64);
+    memcpy(start, NAME.data(), NAME.size());
+    char* p = start + NAME.size();
+    p += format_uint(p, begin);
+    *p++ = '-';
+    p += format_uint(p, end);
+    *p++ = '/';
+    p += format_uint(p, size);
+    *p++ = '\r';
+    *p++ = '\n';
+    written(p - start);
+}
+
+void HeaderWriter::keep_alive(uint64_t timeout, uint64_t max) {
+    static const std::string_view NAME = "Keep-Alive: timeout=";
+    static const std::string_view MAX = ", max=";
+    char* start = reserve(NAME.size() + MAX.size() + 48);
+    memcpy(start, NAME.data(), NAME.size());
+    char* p = start + NAME.size();
+    p += format_uint(p, timeout);
+    if (max > 0) {
+        memcpy(p, MAX.data(), MAX.size());
+        p += MAX.size();
+        p += format_uint(p, max);
+    }
+    *p++ = '\r';
+    *p++ = '\n';
+    written(p - start);
+}
+
+void HeaderWriter::append(std::string_view str) {
+    memcpy(reserve(str.size()), str.data(), str.size());
+    written(str.size());
+}
+
+void HeaderWriter::end() {
+    append("\r\n");
+}
+
+/**
+ * 与10的幂比较得到位数，再从低位开始每次查表转换两位
+*/
+size_t HeaderWriter::format_uint(char* dst, uint64_t value) {
+    size_t len = 1;
+    while (len < 20 && value >= POW10[len]) len++;
+
+    char* p = dst + len;
+    while (value >= 100) {
+        p -= 2;
+        put2(p, static_cast<int>(value % 100));
+        value /= 100;
+    }
+    if (value >= 10) {
+        p -= 2;
+        put2(p, static_cast<int>(value));
+    }
+    else {
+        *--p = static_cast<char>('0' + value);
+    }
+    return len;
+}
+
+size_t HeaderWriter::format_hex(char* dst, uint64_t value) {
+    static const char HEX[] = "0123456789abcdef";
+    size_t len = 1;
+    for (uint64_t v = value; v >= 16; v >>= 4) len++;
+    for (size_t i = len; i > 0; i--) {
+        dst[i - 1] = HEX[value & 15];
+        value >>= 4;
+    }
+    return len;
+}
+
+/**
+ * RFC 7231格式的时间，如"Sun, 06 Nov 1994 08:49:37 GMT"，与locale无关
+*/
+size_t HeaderWriter::format_http_date(char* dst, time_t t) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    memcpy(dst, WEEKDAY[tm.tm_wday], 3);
+    dst[3] = ',';
+    dst[4] = ' ';
+    put2(dst + 5, tm.tm_mday);
+    dst[7] = ' ';
+    memcpy(dst + 8, MONTH[tm.tm_mon], 3);
+    dst[11] = ' ';
+    int year = tm.tm_year + 1900;
+    put2(dst + 12, year / 100 % 100);
+    put2(dst + 14, year % 100);
+    dst[16] = ' ';
+    put2(dst + 17, tm.tm_hour);
+    dst[19] = ':';
+    put2(dst + 20, tm.tm_min);
+    dst[22] = ':';
+    put2(dst + 23, tm.tm_sec);
+    memcpy(dst + 25, " GMT", 4);
+    return 29;
+}
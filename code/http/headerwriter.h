@@ -0,0 +1,51 @@
+/**
+
+ * @Date    :       2021-01-04
+*/
+
+#ifndef __HEADERWRITER_H_
+#define __HEADERWRITER_H_
+
+#include <string_view>
+#include <stdint.h>
+#include <time.h>
+#include "../buffer/buffer.h"
+
+/**
+ * 响应头序列化
+ * 直接写入Buffer的可写区域，不产生std::string临时对象
+ * 状态行预先生成，整数用查两位数字表的方式转换，Date头每个线程每秒格式化一次
+ * 写入的内容先不提交，析构时一次更新Buffer的写位置
+*/
+class HeaderWriter {
+public:
+    explicit HeaderWriter(Buffer& buffer) : buffer_(buffer), pending_(0) {}
+    ~HeaderWriter() { commit(); }
+    HeaderWriter(const HeaderWriter&) = delete;
+    HeaderWriter& operator=(const HeaderWriter&) = delete;
+
+    bool status_line(int code);//未知的状态码返回false，不写入
+    void header(std::string_view name, std::string_view value);
+    void header(std::string_view name, uint64_t value);
+    void date();
+    void last_modified(time_t mtime);
+    void content_range(uint64_t begin, uint64_t end, uint64_t size);//end包含
+    void keep_alive(uint64_t timeout, uint64_t max);//timeout单位秒，max为0时不写
+    void append(std::string_view str);
+    void end();//空行，响应头结束
+    void commit();
+
+    static std::string_view reason(int code);
+    static size_t format_uint(char* dst, uint64_t value);//返回写入的位数，dst至少20字节
+    static size_t format_hex(char* dst, uint64_t value);//dst至少16字节
+    static size_t format_http_date(char* dst, time_t t);//固定29字节
+
+private:
+    char* reserve(size_t len);
+    void written(size_t len) { pending_ += len; }
+
+    Buffer& buffer_;
+    size_t pending_;//已写入可写区域还未提交的字节数
+};
+
+#endif // !__HEADERWRITER_H_
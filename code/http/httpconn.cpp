@@ -7,9 +7,16 @@
 bool HttpConn::is_ET;
 const char* HttpConn::src_dir;
 std::atomic<int> HttpConn::user_count;
+int HttpConn::buffer_size = 1024;
+std::atomic<int> HttpConn::keepalive_max(0);
+std::atomic<int> HttpConn::keepalive_timeout_ms(0);
+std::atomic<int> HttpConn::inflight_count(0);
+std::atomic<bool> HttpConn::is_draining(false);
 
-HttpConn::HttpConn() : fd_(-1), addr_({0}), is_close_(true) {
-
+HttpConn::HttpConn() : fd_(-1), addr_({0}), is_close_(true), conn_seq_(0),
+        request_count_(0), is_keepalive_(false), is_inflight_(false),
+        read_buffer_(buffer_size), write_buffer_(buffer_size), is_sampled_(false), response_bytes_(0) {
+    ip_[0] = '\0';
 }
 
 HttpConn::~HttpConn() {
@@ -21,6 +28,11 @@ void HttpConn::init(int fd, const struct sockaddr_in& addr) {
     user_count++; 
     fd_ = fd;
     addr_ = addr;
+    conn_seq_++;
+    request_count_ = 0;
+    is_keepalive_ = false;
+    if (!inet_ntop(AF_INET, &addr_.sin_addr, ip_, sizeof(ip_))) ip_[0] = '\0';
+    is_sampled_ = false;
     write_buffer_.retrieve_all();
     read_buffer_.retrieve_all();
     is_close_ = false;
@@ -32,7 +44,8 @@ void HttpConn::init(int fd, const struct sockaddr_in& addr) {
  * 关闭套接字
 */
 void HttpConn::close_conn() {
-    response_.unmap_file();
+    response_.close_file();
+    end_request();
     if (!is_close_) {
         is_close_ = true;
         user_count--;
@@ -46,23 +59,23 @@ int HttpConn::get_fd() const {
 }
 
 int HttpConn::get_port() const {
-    return addr_.sin_port;
+    return ntohs(addr_.sin_port);
 }
 
 const char* HttpConn::get_ip() const {
-    return inet_ntoa(addr_.sin_addr);
+    return ip_;
 }
 
 sockaddr_in HttpConn::get_addr() const {
     return addr_;
 }
 
-int HttpConn::to_write_bytes() {
-    return iov_[0].iov_len + iov_[1].iov_len; 
+size_t HttpConn::to_write_bytes() {
+    return iov_[0].iov_len + iov_[1].iov_len + response_.get_file_remain(); 
 }
 
 bool HttpConn::is_keepalive() const {
-    return request_.is_keepalive();
+    return is_keepalive_ && !is_draining;
 }
 
 ssize_t HttpConn::read(int* error) {
@@ -75,14 +88,30 @@ ssize_t HttpConn::read(int* error) {
     return len;
 }
 
+/**
+ * 先聚集写响应头和缓存中的响应体，再sendfile发送文件
+ * 一次最多发送WRITE_LIMIT字节，剩下的等下一次写事件，避免大文件长时间占用工作线程
+*/
 ssize_t HttpConn::write(int* error) {
     ssize_t len = -1;
+    size_t total = 0;
     do {
+        if (iov_[0].iov_len + iov_[1].iov_len == 0) {
+            if (response_.get_file_remain() == 0) break;//数据全部发送完毕
+            len = response_.send_file(fd_);
+            if (len <= 0) {
+                *error = errno;
+                break;
+            }
+            total += len;
+            continue;
+        }
         len = writev(fd_, iov_, iov_len);
         if (len <= 0) {//发送出错退出发送
             *error = errno;
             break;
         }
+        total += len;
         if (iov_[0].iov_len+iov_[1].iov_len == 0) {//数据全部发送完毕
             break;
         }
@@ -101,7 +130,7 @@ ssize_t HttpConn::write(int* error) {
             iov_[0].iov_len -= len;
             write_buffer_.retrieve(len);
         }
-    } while (is_ET || to_write_bytes() > 10240);//直到数据少于10k
+    } while ((is_ET || to_write_bytes() > 10240) && total < WRITE_LIMIT);//直到数据少于10k
     return len;
 }
 
@@ -114,25 +143,128 @@ bool HttpConn::process() {
     request_.init();
 
     if (read_buffer_.get_readable_bytes() <= 0) return false;
-    else if (request_.parse(read_buffer_)) {
-        response_.init(src_dir, request_.get_path(), request_.is_keepalive(), 200);
+
+    is_sampled_ = AccessLog::instance()->sample();
+    if (is_sampled_) process_begin_ = SteadyClock::now();
+
+    bool parsed = request_.parse(read_buffer_);
+    if (is_sampled_) parse_end_ = SteadyClock::now();
+
+    //解析成功或失败都会生成响应，直到发送完都算处理中
+    if (!is_inflight_) {
+        is_inflight_ = true;
+        inflight_count++;
+    }
+
+    if (parsed) {
+        request_count_++;
+        if (request_.is_auth_pending()) return true;//等待数据库校验后再生成响应
+        init_response(200);
+        if (request_.get_method() == "GET") {
+            response_.set_condition(request_.get_header("If-None-Match"),
+                                    request_.get_header("If-Modified-Since"));
+            response_.set_range(request_.get_header("Range"), request_.get_header("If-Range"));
+        }
     }
     else {
+        is_keepalive_ = false;//请求格式错误，后续数据无法定位请求边界
         response_.init(src_dir, request_.get_path(), false, 400);
     }
+    make_response();
+    return true;
+}
+
+/**
+ * 校验完成，按结果生成登录注册的响应，哈希队列满时返回503
+*/
+void HttpConn::finish_auth(Authenticator::RESULT result) {
+    request_.finish_auth(result == Authenticator::AUTH_OK);
+    init_response((result == Authenticator::AUTH_BUSY) ? 503 : 200);
+    make_response();
+}
+
+/**
+ * 初始化响应并决定是否保持连接
+ * 达到请求数上限的连接在这次响应后关闭，Keep-Alive头告知客户端实际的超时和剩余请求数
+*/
+void HttpConn::init_response(int code) {
+    int max = keepalive_max;//重载配置时可能被修改，这次响应只读一次
+    is_keepalive_ = request_.is_keepalive() && !is_draining
+                    && (max <= 0 || request_count_ < max);
+    response_.init(src_dir, request_.get_path(), is_keepalive_, code, request_.get_accept_encoding());
+    if (is_keepalive_) {
+        //向下取整，客户端应当先于服务端放弃空闲连接
+        response_.set_keepalive(keepalive_timeout_ms / 1000,
+                                max > 0 ? max - request_count_ : 0);
+    }
+}
 
+/**
+ * 生成响应报文，响应头和映射的文件分两块聚集写
+*/
+void HttpConn::make_response() {
     response_.make_response(write_buffer_);
 
     iov_[0].iov_base = const_cast<char *>(write_buffer_.peek());
     iov_[0].iov_len = write_buffer_.get_readable_bytes();
     iov_len = 1;
 
-    if (response_.get_file_len() > 0 && response_.get_file_mmptr()) {
-        iov_[1].iov_base = response_.get_file_mmptr();
-        iov_[1].iov_len = response_.get_file_len();
+    iov_[1].iov_base = nullptr;
+    iov_[1].iov_len = 0;
+    if (response_.get_body_len() > 0 && response_.get_body()) {
+        iov_[1].iov_base = const_cast<char *>(response_.get_body());
+        iov_[1].iov_len = response_.get_body_len();
         iov_len = 2;
     }
 
-    LOG_DEBUG("file size: %d,%d to %d", response_.get_file_len(), iov_len, to_write_bytes());
-    return true;
+    response_bytes_ = to_write_bytes();
+    if (is_sampled_) handle_end_ = SteadyClock::now();
+
+    LOG_DEBUG("body size: %d,%d to %llu", static_cast<int>(response_.get_body_len()), iov_len,
+                static_cast<unsigned long long>(to_write_bytes()));
+}
+
+bool HttpConn::is_inflight() const {
+    return is_inflight_;
+}
+
+void HttpConn::end_request() {
+    if (is_inflight_) {
+        is_inflight_ = false;
+        inflight_count--;
+    }
+}
+
+bool HttpConn::is_auth_pending() const {
+    return request_.is_auth_pending();
+}
+
+void HttpConn::get_auth(std::string& name, std::string& password, bool& is_login) {
+    request_.get_auth(name, password, is_login);
+}
+
+uint64_t HttpConn::get_conn_seq() const {
+    return conn_seq_;
+}
+
+bool HttpConn::is_closed() const {
+    return is_close_;
+}
+
+/**
+ * 记录访问日志
+ * 解析耗时：解析请求；处理耗时：生成响应；发送耗时：从生成响应到全部发送完
+*/
+void HttpConn::log_access() {
+    if (!is_sampled_) return;
+    is_sampled_ = false;
+
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    SteadyClock::time_point write_end = SteadyClock::now();
+    AccessLog::instance()->record(ip_, get_port(), request_.get_method(), request_.get_path(),
+                                response_.get_code(), response_bytes_,
+                                static_cast<long>(duration_cast<microseconds>(parse_end_ - process_begin_).count()),
+                                static_cast<long>(duration_cast<microseconds>(handle_end_ - parse_end_).count()),
+                                static_cast<long>(duration_cast<microseconds>(write_end - handle_end_).count()));
 }
@@ -9,9 +9,12 @@
 
 #include <arpa/inet.h>
 #include <atomic>
+#include <chrono>
 #include <sys/uio.h>
 #include "../buffer/buffer.h"
 #include "../log/log.h"
+#include "../log/accesslog.h"
+#include "../pool/authenticator.h"
 #include "httprequest.h"
 #include "httpresponse.h"
 
@@ -32,19 +35,46 @@ public:
     sockaddr_in get_addr() const;
 
     bool process();
-    int to_write_bytes();//还要发送的数据量大小
+    size_t to_write_bytes();//还要发送的数据量大小，包括未发送的文件部分，可能超过2G
+
+    //登录注册请求等待校验期间连接被挂起，校验完成后再生成响应
+    bool is_auth_pending() const;
+    void get_auth(std::string& name, std::string& password, bool& is_login);
+    void finish_auth(Authenticator::RESULT result);
+    uint64_t get_conn_seq() const;
+    bool is_closed() const;
 
     bool is_keepalive() const;
+    void log_access();//响应发送完毕后记录访问日志
+    void end_request();//响应发送完毕或连接关闭，不再计入处理中的请求
+    bool is_inflight() const;
 
     static bool is_ET;
     static const char* src_dir;
     static std::atomic<int> user_count;
+    static int buffer_size;//读写缓冲区的初始大小
+    static std::atomic<int> keepalive_max;//每个长连接最多处理的请求数，0表示不限制
+    static std::atomic<int> keepalive_timeout_ms;//当前的空闲超时，连接数接近上限时由WebServer调小
+    static std::atomic<int> inflight_count;//已收到完整请求、还没发送完响应的请求数
+    static std::atomic<bool> is_draining;//服务正在退出，响应发送完后关闭连接
 
 private:
+    typedef std::chrono::steady_clock SteadyClock;
+
+    void init_response(int code);
+    void make_response();
+
+    static const size_t WRITE_LIMIT = 4 << 20;//一次写事件最多发送的字节数
+
     int fd_;
     struct sockaddr_in addr_;
+    char ip_[INET_ADDRSTRLEN];//init时转换好，inet_ntoa使用静态缓冲区不能在多线程中调用
 
     bool is_close_;
+    uint64_t conn_seq_;//每次init递增，用于识别异步结果是否还属于当前连接
+    int request_count_;//此连接已处理的请求数
+    bool is_keepalive_;//当前响应发送完后是否保持连接
+    std::atomic<bool> is_inflight_;//工作线程设置，退出时事件循环据此判断连接是否空闲
 
     struct iovec iov_[2];
     int iov_len;
@@ -54,6 +84,13 @@ private:
 
     HttpRequest request_;
     HttpResponse response_;
+
+    //访问日志需要的请求耗时打点
+    bool is_sampled_;//当前请求是否记录访问日志
+    size_t response_bytes_;
+    SteadyClock::time_point process_begin_;
+    SteadyClock::time_point parse_end_;
+    SteadyClock::time_point handle_end_;
 };
 
 #endif // !__HTTPCON_H_
\ No newline at end of file
@@ -4,6 +4,8 @@
 */
 
 #include "httprequest.h"
+#include <stdlib.h>
+#include <strings.h>
 
 /*默认页面索引*/
 const std::unordered_set<std::string> HttpRequest::DEFAULT_HTML {
@@ -26,12 +28,79 @@ void HttpRequest::init() {
     method_ = path_ = version_ = body_ = "";
     headers_.clear();
     post_.clear();
+    auth_pending_ = false;
+    is_login_ = false;
 }
 
+/**
+ * 是否保持连接
+ * HTTP/1.1默认长连接，除非Connection中带close；HTTP/1.0需要显式的keep-alive
+ * Connection是逗号分隔的选项列表，不区分大小写
+*/
 bool HttpRequest::is_keepalive() const {
-    if (headers_.count("Connection"))
-        return headers_.find("Connection")->second == "keep-alive" && version_ == "1.1";
-    return false;
+    bool keepalive = (version_ == "1.1");
+    auto it = headers_.find("Connection");
+    if (it == headers_.end()) return keepalive;
+
+    const std::string& value = it->second;
+    size_t pos = 0;
+    while (pos < value.size()) {
+        size_t end = value.find(',', pos);
+        if (end == std::string::npos) end = value.size();
+        size_t begin = pos, last = end;
+        while (begin < last && (value[begin] == ' ' || value[begin] == '\t')) begin++;
+        while (last > begin && (value[last-1] == ' ' || value[last-1] == '\t')) last--;
+        std::string_view token(value.data() + begin, last - begin);
+        if (token.size() == 5 && strncasecmp(token.data(), "close", 5) == 0) return false;
+        if (token.size() == 10 && strncasecmp(token.data(), "keep-alive", 10) == 0) keepalive = true;
+        pos = end + 1;
+    }
+    return keepalive;
+}
+
+/**
+ * 解析Accept-Encoding，如"gzip, deflate;q=0.5, br;q=0"
+ * q=0表示明确拒绝，*表示接受所有格式
+*/
+int HttpRequest::get_accept_encoding() const {
+    auto it = headers_.find("Accept-Encoding");
+    if (it == headers_.end()) return 0;
+
+    int accept = 0, refused = 0;
+    bool any = false;
+    const std::string& value = it->second;
+    size_t pos = 0;
+    while (pos < value.size()) {
+        size_t end = value.find(',', pos);
+        if (end == std::string::npos) end = value.size();
+        size_t semi = value.find(';', pos);
+        size_t name_end = (semi < end) ? semi : end;
+
+        size_t begin = pos;
+        while (begin < name_end && value[begin] == ' ') begin++;
+        while (name_end > begin && value[name_end-1] == ' ') name_end--;
+        std::string coding = value.substr(begin, name_end - begin);
+
+        int flag = 0;
+        if (strcasecmp(coding.c_str(), "gzip") == 0 || strcasecmp(coding.c_str(), "x-gzip") == 0) {
+            flag = ACCEPT_GZIP;
+        }
+        else if (strcasecmp(coding.c_str(), "br") == 0) {
+            flag = ACCEPT_BR;
+        }
+
+        bool rejected = false;
+        if (semi < end) {
+            size_t q = value.find("q=", semi);
+            if (q < end) rejected = (atof(value.c_str() + q + 2) <= 0);
+        }
+        if (coding == "*") any = !rejected;
+        else if (rejected) refused |= flag;
+        else accept |= flag;
+        pos = end + 1;
+    }
+    if (any) accept |= (ACCEPT_GZIP | ACCEPT_BR) & ~refused;//*不覆盖明确拒绝的格式
+    return accept;
 }
 
 /**
@@ -118,25 +187,45 @@ void HttpRequest::parse_body(const std::string& line) {
     LOG_DEBUG("body: %s, len: %d", body_.c_str(), body_.length());
 }
 
+/**
+ * 解析表单，登录注册请求只标记为等待校验，
+ * 查询数据库由调用者交给数据库线程，避免阻塞处理请求的线程
+*/
 void HttpRequest::parse_post() {
-    if (method_ != "POST" && headers_["Content-Type"] == "application/x-www-form-urlencoded") {
+    if (method_ == "POST" && headers_["Content-Type"] == "application/x-www-form-urlencoded") {
         parse_form_urlencoded();
         if (DEFAULT_HTML_TAG.count(path_)) {
             int tag = DEFAULT_HTML_TAG.find(path_)->second;
             LOG_DEBUG("Tag: %d", tag);
             if (tag == 0 || tag == 1) {
-                bool is_login = (tag == 1);
-                if (user_verify(post_["username"], post_["password"], is_login)) {
-                    path_ = "/welcome.html";
-                }
-                else {
-                    path_ = "/error.html";
-                }
+                is_login_ = (tag == 1);
+                auth_pending_ = true;
             }
         }
     }
 }
 
+bool HttpRequest::is_auth_pending() const {
+    return auth_pending_;
+}
+
+/**
+ * 取出待校验的用户名和密码，拷贝给数据库线程使用
+*/
+void HttpRequest::get_auth(std::string& name, std::string& password, bool& is_login) {
+    name = post_["username"];
+    password = post_["password"];
+    is_login = is_login_;
+}
+
+/**
+ * 回填校验结果，决定返回的页面
+*/
+void HttpRequest::finish_auth(bool verified) {
+    path_ = verified ? "/welcome.html" : "/error.html";
+    auth_pending_ = false;
+}
+
 int HttpRequest::convert_hex(char ch) {
     if(ch >= 'A' && ch <= 'F') return ch -'A' + 10;
     if(ch >= 'a' && ch <= 'f') return ch -'a' + 10;
@@ -184,69 +273,6 @@ void HttpRequest::parse_form_urlencoded(){
     }
 }
 
-bool HttpRequest::user_verify(const std::string &name, const std::string &pwd, bool isLogin) {
-    if(name == "" || pwd == "") return false;
-    
-    LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
-    MYSQL* sql;
-    SqlConRAII(&sql,  SqlConPool::instance());
-    assert(sql);
-    
-    bool flag = false;
-    unsigned int j = 0;
-    char order[256] = { 0 };
-    MYSQL_FIELD *fields = nullptr;
-    MYSQL_RES *res = nullptr;
-    
-    if(!isLogin) { flag = true; }
-    /* 查询用户及密码 */
-    snprintf(order, 256, "SELECT username, password FROM user WHERE username='%s' LIMIT 1", name.c_str());
-    LOG_DEBUG("%s", order);
-
-    if(mysql_query(sql, order)) { 
-        mysql_free_result(res);
-        return false; 
-    }
-    res = mysql_store_result(sql);
-    j = mysql_num_fields(res);
-    fields = mysql_fetch_fields(res);
-
-    while(MYSQL_ROW row = mysql_fetch_row(res)) {
-        LOG_DEBUG("MYSQL ROW: %s %s", row[0], row[1]);
-        std::string password(row[1]);
-        /* 注册行为 且 用户名未被使用*/
-        if(isLogin) {
-            if(pwd == password) { flag = true; }
-            else {
-                flag = false;
-                LOG_DEBUG("pwd error!");
-            }
-        } 
-        else { 
-            flag = false; 
-            LOG_DEBUG("user used!");
-        }
-    }
-    mysql_free_result(res);
-
-    /* 注册行为 且 用户名未被使用*/
-    if(!isLogin && flag == true) {
-        LOG_DEBUG("regirster!");
-        bzero(order, 256);
-        snprintf(order, 256,"INSERT INTO user(username, password) VALUES('%s','%s')", name.c_str(), pwd.c_str());
-        LOG_DEBUG( "%s", order);
-        if(mysql_query(sql, order)) { 
-            LOG_DEBUG( "Insert error!");
-            flag = false; 
-        }
-        flag = true;
-    }
-    SqlConPool::instance()->free_connection(sql);
-    LOG_DEBUG( "UserVerify success!!");
-    return flag;
-}
-
-
 std::string HttpRequest::get_path() const {
     return path_;
 }
@@ -271,4 +297,11 @@ std::string HttpRequest::get_post(const char* key) const {
     assert(key);
     if (post_.count(key)) return post_.find(key)->second;
     return "";
+}
+
+std::string HttpRequest::get_header(const char* key) const {
+    assert(key);
+    auto it = headers_.find(key);
+    if (it != headers_.end()) return it->second;
+    return "";
 }
\ No newline at end of file
@@ -10,11 +10,9 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
+#include <string_view>
 #include <algorithm>
 #include <regex>
-#include <mysql/mysql.h>
-#include "../pool/sqlconRAII.h"
-#include "../pool/sqlconpool.h"
 #include "../buffer/buffer.h"
 #include "../log/log.h"
 
@@ -51,9 +49,21 @@ public:
     std::string get_version() const;
     std::string get_post(const std::string& key) const;
     std::string get_post(const char* key) const;
+    std::string get_header(const char* key) const;
 
     bool is_keepalive() const;
 
+    enum ACCEPT_ENCODING {//客户端接受的压缩格式，按位组合
+        ACCEPT_GZIP = 1,
+        ACCEPT_BR = 2,
+    };
+    int get_accept_encoding() const;
+
+    //登录注册的数据库校验不在解析时进行，由数据库线程异步完成后回填结果
+    bool is_auth_pending() const;
+    void get_auth(std::string& name, std::string& password, bool& is_login);
+    void finish_auth(bool verified);
+
 private:
     bool parse_request_line(const std::string& line);
     void parse_headers(const std::string& line);
@@ -63,7 +73,6 @@ private:
     void parse_post();
     void parse_form_urlencoded();
 
-    static bool user_verify(const std::string& name, const std::string& password, bool is_login);
     static int convert_hex(char ch);
 
 private:
@@ -72,6 +81,9 @@ private:
     std::unordered_map<std::string, std::string> headers_;
     std::unordered_map<std::string, std::string> post_;
 
+    bool auth_pending_;//等待数据库校验用户
+    bool is_login_;//true登录，false注册
+
     static const std::unordered_set<std::string> DEFAULT_HTML;
     static const std::unordered_map<std::string, int> DEFAULT_HTML_TAG;
 };
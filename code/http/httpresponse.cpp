@@ -5,36 +5,10 @@
 
 #include "httpresponse.h"
 
-#include <iostream>
-
-const std::unordered_map<std::string, std::string> HttpResponse::SUFFIX_TYPE = {
-    { ".html",  "text/html" },
-    { ".xml",   "text/xml" },
-    { ".xhtml", "application/xhtml+xml" },
-    { ".txt",   "text/plain" },
-    { ".rtf",   "application/rtf" },
-    { ".pdf",   "application/pdf" },
-    { ".word",  "application/nsword" },
-    { ".png",   "image/png" },
-    { ".gif",   "image/gif" },
-    { ".jpg",   "image/jpeg" },
-    { ".jpeg",  "image/jpeg" },
-    { ".au",    "audio/basic" },
-    { ".mpeg",  "video/mpeg" },
-    { ".mpg",   "video/mpeg" },
-    { ".avi",   "video/x-msvideo" },
-    { ".gz",    "application/x-gzip" },
-    { ".tar",   "application/x-tar" },
-    { ".css",   "text/css "},
-    { ".js",    "text/javascript "},
-};
-
-const std::unordered_map<int, std::string> HttpResponse::CODE_STATUS = {
-    { 200, "OK" },
-    { 400, "Bad Request" },
-    { 403, "Forbidden" },
-    { 404, "Not Found" },
-};
+#include <time.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 
 const std::unordered_map<int, std::string> HttpResponse::CODE_PATH = {
     { 400, "/400.html" },
@@ -42,60 +16,169 @@ const std::unordered_map<int, std::string> HttpResponse::CODE_PATH = {
     { 404, "/404.html" },
 };
 
+//页面内容会更新，每次都向服务器确认；其他静态资源缓存一天
+std::unordered_map<std::string, std::string> HttpResponse::CACHE_CONTROL = {
+    { "text/html", "no-cache" },
+    { "*", "public, max-age=86400" },
+};
+
 HttpResponse::HttpResponse() {
     code_ = -1;
     path_ = src_dir_ = "";
     is_keepalive_ = false;
-    mm_file_ = nullptr;
-    mm_file_stat_ = {0};
+    keepalive_timeout_ = keepalive_max_ = 0;
+    accept_encoding_ = 0;
+    file_stat_ = {0};
+    is_range_ = false;
+    range_begin_ = range_end_ = 0;
+    body_ = nullptr;
+    body_len_ = 0;
+    file_fd_ = -1;
+    file_offset_ = 0;
+    file_remain_ = 0;
 }
 
 HttpResponse::~HttpResponse() {
-    unmap_file();
+    close_file();
 }
 
 /**
  * 响应初始化
 */
-void HttpResponse::init(const std::string& src_dir, const std::string& path, bool is_keepalive, int code) {
+void HttpResponse::init(const std::string& src_dir, const std::string& path, bool is_keepalive,
+                        int code, int accept_encoding) {
     assert(src_dir != "");
-    if (mm_file_) unmap_file();
+    close_file();
     code_ = code;
     is_keepalive_ = is_keepalive;
+    keepalive_timeout_ = keepalive_max_ = 0;
+    accept_encoding_ = accept_encoding;
     path_ = path;
     src_dir_ = src_dir;
-    mm_file_ = nullptr;
-    mm_file_stat_ = {0};
+    file_stat_ = {0};
+    if_none_match_.clear();
+    if_modified_since_.clear();
+    matched_etag_.clear();
+    range_.clear();
+    if_range_.clear();
+    is_range_ = false;
+}
+
+/**
+ * 设置长连接的空闲超时和剩余请求数，写在Keep-Alive头中
+*/
+void HttpResponse::set_keepalive(int timeout_s, int max) {
+    keepalive_timeout_ = timeout_s;
+    keepalive_max_ = max;
+}
+
+/**
+ * 设置条件请求头，文件未修改时返回304
+*/
+void HttpResponse::set_condition(const std::string& if_none_match, const std::string& if_modified_since) {
+    if_none_match_ = if_none_match;
+    if_modified_since_ = if_modified_since;
+}
+
+/**
+ * 设置范围请求头，If-Range与当前文件不符时忽略Range返回整个文件
+*/
+void HttpResponse::set_range(const std::string& range, const std::string& if_range) {
+    range_ = range;
+    if_range_ = if_range;
+}
+
+/**
+ * 设置某类内容的Cache-Control，value为空时删除
+*/
+void HttpResponse::set_cache_control(const std::string& type, const std::string& value) {
+    if (value.empty()) CACHE_CONTROL.erase(type);
+    else CACHE_CONTROL[type] = value;
+}
+
+/**
+ * 从配置加载Cache-Control规则，格式为"type=value;type=value"，如
+ *   text/html=no-cache;image/png=public, max-age=604800;*=public, max-age=86400
+ * 规则覆盖内置的同类型设置，value为空时删除。表没有加锁，只能在工作线程启动前调用
+*/
+bool HttpResponse::load_cache_control(const std::string& rules) {
+    size_t pos = 0;
+    while (pos < rules.size()) {
+        size_t end = rules.find(';', pos);
+        if (end == std::string::npos) end = rules.size();
+        std::string rule = rules.substr(pos, end - pos);
+        pos = end + 1;
+        size_t begin = rule.find_first_not_of(' ');
+        if (begin == std::string::npos) continue;
+
+        size_t eq = rule.find('=');
+        if (eq == std::string::npos || eq <= begin) return false;
+        size_t type_end = rule.find_last_not_of(' ', eq - 1);
+        size_t value_begin = rule.find_first_not_of(' ', eq + 1);
+        set_cache_control(rule.substr(begin, type_end - begin + 1),
+                          value_begin == std::string::npos ? "" : rule.substr(value_begin));
+    }
+    return true;
 }
 
 /**
  * 生成响应
 */
 void HttpResponse::make_response(Buffer& buffer) {
-    if (stat((src_dir_ + path_).data(), &mm_file_stat_) < 0 || S_ISDIR(mm_file_stat_.st_mode)) {
+    HeaderWriter writer(buffer);
+    if (code_ == 503) {//服务繁忙，不读文件，直接返回简短的出错页面
+        add_state_line(writer);
+        add_header(writer, "text/html");
+        error_content(writer, "server busy, try again later");
+        return;
+    }
+    if (stat((src_dir_ + path_).data(), &file_stat_) < 0 || S_ISDIR(file_stat_.st_mode)) {
         code_ = 404;
     }
-    else if (!(mm_file_stat_.st_mode & S_IROTH)) {
+    else if (!(file_stat_.st_mode & S_IROTH)) {
         code_ = 403;
     }
+    else if (code_ == 200 && is_not_modified()) {//客户端缓存仍然有效，不打开文件
+        code_ = 304;
+        add_state_line(writer);
+        add_header(writer);
+        add_validators(writer, matched_etag_);
+        writer.end();
+        return;
+    }
+    else if (code_ == 200 && !range_.empty()) {
+        if (!parse_range()) {//范围超出文件
+            code_ = 416;
+            add_state_line(writer);
+            add_header(writer, "text/html");//响应体是出错页面，不是请求的文件
+            writer.append("Content-Range: bytes */");
+            char size[24];
+            writer.append(std::string_view(size, HeaderWriter::format_uint(size, file_stat_.st_size)));
+            writer.append("\r\n");
+            error_content(writer, "range not satisfiable");
+            return;
+        }
+        if (is_range_) code_ = 206;
+    }
     error_html();
-    add_state_line(buffer);
-    add_header(buffer);
-    add_content(buffer);
+    entry_ = FileCache::instance()->get(src_dir_ + path_, file_stat_);
+    add_state_line(writer);
+    add_header(writer);
+    add_content(writer);
 }
 
 /**
- * 获取文件映射内存地址
+ * 获取响应体地址，没有响应体或响应体已写入buffer时为空
 */
-char* HttpResponse::get_file_mmptr() {
-    return mm_file_;
+const char* HttpResponse::get_body() const {
+    return body_;
 }
 
 /**
- * 获取文件大小
+ * 获取响应体大小，压缩发送时为压缩后的大小
 */
-size_t HttpResponse::get_file_len() const {
-    return mm_file_stat_.st_size;
+size_t HttpResponse::get_body_len() const {
+    return body_len_;
 }
 
 /**
@@ -104,104 +187,287 @@ size_t HttpResponse::get_file_len() const {
 void HttpResponse::error_html() {
     if (CODE_PATH.count(code_)) {//找得到对应的错误代码页面
         path_ = CODE_PATH.find(code_)->second;//更新文件请求资源路径
-        stat((src_dir_ + path_).data(), &mm_file_stat_);//获取文件信息
+        stat((src_dir_ + path_).data(), &file_stat_);//获取文件信息
     }
 }
 
 /**
  * 添加响应状态行
 */
-void HttpResponse::add_state_line(Buffer& buffer) {
-    std::string status;
-    if (CODE_STATUS.count(code_)) {//转化错误代码对应的相应信息
-        status = CODE_STATUS.find(code_)->second;
-    }
-    else {
+void HttpResponse::add_state_line(HeaderWriter& writer) {
+    if (!writer.status_line(code_)) {//未知的状态码按400处理
         code_ = 400;
-        status = CODE_STATUS.find(code_)->second;
+        writer.status_line(code_);
     }
-    buffer.append("HTTP/1.1 " + std::to_string(code_) + " " + status + "\r\n");
 }
 
 /**
  * 添加响应头
 */
-void HttpResponse::add_header(Buffer& buffer) {
-    buffer.append("Connection: ");
+void HttpResponse::add_header(HeaderWriter& writer, std::string_view type) {
     if (is_keepalive_) {
-        buffer.append("keep-alive\r\n");
-        buffer.append("keep-alive: max=6, timeout=120\r\n");
+        writer.append("Connection: keep-alive\r\n");
+        if (keepalive_timeout_ > 0) writer.keep_alive(keepalive_timeout_, keepalive_max_);
     } 
     else {
-        buffer.append("close\r\n");
+        writer.append("Connection: close\r\n");
     }
-    buffer.append("Content-type: " + get_file_type() + "\r\n");
+    writer.date();
+    writer.header("Content-type", type.empty() ? get_file_type() : type);
 }
 
 /**
  * 添加响应body
+ * 范围请求只发送未压缩的内容
 */
-void HttpResponse::add_content(Buffer& buffer) {
-    int src_fd = open((src_dir_+ path_).data(), O_RDONLY);
-    if (src_fd < 0) {
-        error_content(buffer, "file not fount!");
+void HttpResponse::add_content(HeaderWriter& writer) {
+    char etag[ETAG_SIZE];
+    if (code_ == 200 || code_ == 206) writer.append("Accept-Ranges: bytes\r\n");
+    if (is_range_) {
+        add_validators(writer, std::string_view(etag, make_etag(etag, "")));
+        writer.content_range(range_begin_, range_end_, file_stat_.st_size);
+    }
+    size_t begin = is_range_ ? range_begin_ : 0;
+    size_t len = is_range_ ? range_end_ - range_begin_ + 1 : file_stat_.st_size;
+
+    if (entry_ && is_range_) {
+        if (entry_->compressible()) writer.append("Vary: Accept-Encoding\r\n");
+        body_ = entry_->data.data() + begin;
+        body_len_ = len;
+        writer.header("Content-length", body_len_);
+        writer.end();
+        return;
+    }
+    //小文件从文件缓存发送，客户端接受时发送压缩好的版本
+    if (entry_) {
+        const std::string* body = &entry_->data;
+        if ((accept_encoding_ & HttpRequest::ACCEPT_BR) && !entry_->br.empty()) {
+            body = &entry_->br;
+            writer.append("Content-Encoding: br\r\n");
+        }
+        else if ((accept_encoding_ & HttpRequest::ACCEPT_GZIP) && !entry_->gzip.empty()) {
+            body = &entry_->gzip;
+            writer.append("Content-Encoding: gzip\r\n");
+        }
+        //有压缩版本的资源响应随Accept-Encoding变化，告知中间缓存
+        if (entry_->compressible()) writer.append("Vary: Accept-Encoding\r\n");
+        if (code_ == 200) {
+            const char* suffix = (body == &entry_->br) ? "-br" : (body == &entry_->gzip ? "-gz" : "");
+            add_validators(writer, std::string_view(etag, make_etag(etag, suffix)));
+        }
+        body_ = body->data();
+        body_len_ = body->size();
+        writer.header("Content-length", body_len_);
+        writer.end();
         return;
     }
 
-    LOG_DEBUG("file path: %s", ((src_dir_ + path_).data()));
-    int *mm_ret = (int *)mmap(0, mm_file_stat_.st_size, PROT_READ, MAP_PRIVATE, src_fd, 0);
-    if (mm_ret < 0) {
-        error_content(buffer, "file not fount!");
-        return ;
+    //不在缓存中的文件打开后由send_file分段发送
+    file_fd_ = open((src_dir_+ path_).data(), O_RDONLY);
+    if (file_fd_ < 0) {
+        error_content(writer, "file not fount!");
+        return;
     }
-    mm_file_ = (char *)mm_ret;
-    close(src_fd);
-    buffer.append("Content-length: " + std::to_string(mm_file_stat_.st_size) + "\r\n\r\n");
+
+    LOG_DEBUG("file path: %s", ((src_dir_ + path_).data()));
+    if (code_ == 200) add_validators(writer, std::string_view(etag, make_etag(etag, "")));
+    file_offset_ = begin;
+    file_remain_ = len;
+    writer.header("Content-length", len);
+    writer.end();
 }
 
 /**
- * 取消文件内存映射
+ * 还要sendfile发送的文件字节数
 */
-void HttpResponse::unmap_file() {
-    if (mm_file_) {
-        munmap(mm_file_, mm_file_stat_.st_size);
-        mm_file_ = nullptr;
-    }
+size_t HttpResponse::get_file_remain() const {
+    return file_remain_;
 }
 
 /**
- * 根据文件的后缀名在map获取响应文件类型头
+ * 向套接字发送一段文件内容，每次最多SEND_WINDOW字节
+ * 返回发送的字节数，出错返回-1
 */
-std::string HttpResponse::get_file_type() {
-    std::string::size_type pos = path_.find_last_of('.');
-    if (pos == std::string::npos) return "text/plain";
+ssize_t HttpResponse::send_file(int sock_fd) {
+    size_t count = file_remain_ < SEND_WINDOW ? file_remain_ : SEND_WINDOW;
+    ssize_t len = sendfile(sock_fd, file_fd_, &file_offset_, count);
+    if (len > 0) {
+        file_remain_ -= len;
+        if (file_remain_ == 0) close_file();
+    }
+    else if (len == 0) {//文件在发送过程中被截断
+        LOG_WARN("file %s truncated while sending", path_.c_str());
+        errno = EIO;
+        len = -1;
+    }
+    return len;
+}
 
-    std::string suffix = path_.substr(pos);
-    if (SUFFIX_TYPE.count(suffix)) return SUFFIX_TYPE.find(suffix)->second;
+/**
+ * 关闭发送中的文件，释放持有的缓存条目
+*/
+void HttpResponse::close_file() {
+    if (file_fd_ >= 0) {
+        close(file_fd_);
+        file_fd_ = -1;
+    }
+    file_remain_ = 0;
+    entry_.reset();
+    body_ = nullptr;
+    body_len_ = 0;
+}
 
-    return "text/plain";
+/**
+ * 获取响应文件类型，缓存的文件直接使用加载时查好的类型
+*/
+std::string_view HttpResponse::get_file_type() const {
+    if (entry_) return entry_->type;
+    return MimeType::lookup(path_);
 }
 
 /**
  * 生成出错页面
 */
-void HttpResponse::error_content(Buffer& buffer, std::string message) {
+void HttpResponse::error_content(HeaderWriter& writer, std::string message) {
     std::string body;
-    std::string status;
+    std::string_view status = HeaderWriter::reason(code_);
+    if (status.empty()) status = "Bad Request";
 
     body +="<html><title>Error</title>";
     body += "<body bgcolor=\"ffffff\">";
+    body += std::to_string(code_) + " : ";
+    body += status;
+    body += "\n";
+    body += "<p>" + message + "</p>";
+    body += "<hr><em>TinyServer</em></body></html>";
+
+    writer.header("Content-length", body.size());
+    writer.end();
+    writer.append(body);
+}
+
+/**
+ * 由inode、大小和修改时间生成ETag写入dst，返回长度
+ * 压缩版本加上编码后缀以区分不同的表示
+*/
+size_t HttpResponse::make_etag(char* dst, std::string_view suffix) const {
+    uint64_t mtime = static_cast<uint64_t>(file_stat_.st_mtim.tv_sec) * 1000000000ULL
+                        + file_stat_.st_mtim.tv_nsec;
+    char* p = dst;
+    *p++ = '"';
+    p += HeaderWriter::format_hex(p, file_stat_.st_ino);
+    *p++ = '-';
+    p += HeaderWriter::format_hex(p, file_stat_.st_size);
+    *p++ = '-';
+    p += HeaderWriter::format_hex(p, mtime);
+    memcpy(p, suffix.data(), suffix.size());
+    p += suffix.size();
+    *p++ = '"';
+    return p - dst;
+}
 
-    if(CODE_STATUS.count(code_) == 1) {
-        status = CODE_STATUS.find(code_)->second;
-    } else {
-        status = "Bad Request";
+/**
+ * 判断客户端缓存的文件是否仍然有效
+ * 有If-None-Match时只比较ETag(弱比较，忽略编码后缀)，否则比较If-Modified-Since
+*/
+bool HttpResponse::is_not_modified() {
+    char etag[ETAG_SIZE];
+    size_t etag_len = make_etag(etag, "");
+    if (!if_none_match_.empty()) {
+        std::string base(etag + 1, etag_len - 2);
+        size_t pos = 0;
+        while (pos < if_none_match_.size()) {
+            size_t end = if_none_match_.find(',', pos);
+            if (end == std::string::npos) end = if_none_match_.size();
+            std::string tag = if_none_match_.substr(pos, end - pos);
+            pos = end + 1;
+
+            size_t begin = tag.find_first_not_of(' ');
+            if (begin == std::string::npos) continue;
+            tag = tag.substr(begin, tag.find_last_not_of(' ') - begin + 1);
+            if (tag == "*") {
+                matched_etag_.assign(etag, etag_len);
+                return true;
+            }
+            std::string opaque = tag;
+            if (opaque.compare(0, 2, "W/") == 0) opaque = opaque.substr(2);
+            if (opaque.size() < 2 || opaque.front() != '"' || opaque.back() != '"') continue;
+            opaque = opaque.substr(1, opaque.size() - 2);
+            if (opaque == base || opaque == base + "-gz" || opaque == base + "-br") {
+                matched_etag_ = tag;
+                return true;
+            }
+        }
+        return false;
     }
 
-    body += std::to_string(code_) + " : " + status  + "\n";
-    body += "<p>" + message + "</p>";
-    body += "<hr><em>TinyServer</em></body></html>";
+    if (!if_modified_since_.empty()) {
+        struct tm tm = {};
+        const char* end = strptime(if_modified_since_.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        if (!end) return false;
+        if (file_stat_.st_mtime <= timegm(&tm)) {
+            matched_etag_.assign(etag, etag_len);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * 添加缓存校验相关的响应头：ETag、Last-Modified和Cache-Control
+ * Cache-Control先按完整类型查，再按大类查，最后用默认值
+*/
+void HttpResponse::add_validators(HeaderWriter& writer, std::string_view etag) {
+    writer.header("ETag", etag);
+    writer.last_modified(file_stat_.st_mtime);
 
-    buffer.append("Content-length: " + std::to_string(body.size()) + "\r\n\r\n");
-    buffer.append(body);
+    std::string type(get_file_type());
+    auto it = CACHE_CONTROL.find(type);
+    if (it == CACHE_CONTROL.end()) it = CACHE_CONTROL.find(type.substr(0, type.find('/')) + "/*");
+    if (it == CACHE_CONTROL.end()) it = CACHE_CONTROL.find("*");
+    if (it != CACHE_CONTROL.end()) writer.header("Cache-Control", it->second);
+}
+
+/**
+ * 解析Range: bytes=a-b、bytes=a-、bytes=-n，只支持单个范围
+ * 多个范围、格式不对或If-Range不符时忽略Range，返回整个文件
+ * 范围完全超出文件时返回false
+*/
+bool HttpResponse::parse_range() {
+    is_range_ = false;
+    char etag[ETAG_SIZE];
+    if (!if_range_.empty() && if_range_ != std::string_view(etag, make_etag(etag, ""))) {
+        char date[32];
+        if (if_range_ != std::string_view(date, HeaderWriter::format_http_date(date, file_stat_.st_mtime))) {
+            return true;
+        }
+    }
+    if (range_.compare(0, 6, "bytes=") != 0 || range_.find(',') != std::string::npos) return true;
+
+    const char* p = range_.c_str() + 6;
+    const char* dash = strchr(p, '-');
+    if (!dash) return true;
+    off_t size = file_stat_.st_size;
+    char* end;
+    if (dash == p) {//后缀范围，最后n个字节
+        long long n = strtoll(dash + 1, &end, 10);
+        if (end == dash + 1 || *end != '\0' || n < 0) return true;
+        if (n == 0 || size == 0) return false;
+        range_begin_ = n < size ? size - n : 0;
+        range_end_ = size - 1;
+    }
+    else {
+        long long begin = strtoll(p, &end, 10);
+        if (end != dash || begin < 0) return true;
+        long long last = size - 1;
+        if (dash[1] != '\0') {
+            last = strtoll(dash + 1, &end, 10);
+            if (*end != '\0' || last < begin) return true;
+        }
+        if (begin >= size) return false;
+        range_begin_ = begin;
+        range_end_ = last < size ? last : size - 1;
+    }
+    is_range_ = true;
+    return true;
 }
@@ -6,13 +6,18 @@
 #define __HTTPRESPONSE_H_
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
-#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include "../buffer/buffer.h"
 #include "../log/log.h"
+#include "httprequest.h"
+#include "filecache.h"
+#include "mimetype.h"
+#include "headerwriter.h"
 
 class HttpResponse {
 public:
@@ -20,36 +25,72 @@ public:
     ~HttpResponse();
 
     void init(const std::string& sir_dir, const std::string& path, 
-              bool is_keepalive = false, int code = -1);
+              bool is_keepalive = false, int code = -1, int accept_encoding = 0);
+    void set_condition(const std::string& if_none_match, const std::string& if_modified_since);
+    void set_range(const std::string& range, const std::string& if_range);
+    void set_keepalive(int timeout_s, int max);//Keep-Alive头的内容，max为0表示不限制
     void make_response(Buffer& buffer);
-    void unmap_file();
-    char* get_file_mmptr();
-    size_t get_file_len() const;
-    void error_content(Buffer& buff, std::string message);
+    void close_file();
+    const char* get_body() const;//响应体，来自文件缓存，不在缓存中的文件由send_file发送
+    size_t get_body_len() const;
+    size_t get_file_remain() const;
+    ssize_t send_file(int sock_fd);
+    void error_content(HeaderWriter& writer, std::string message);
     int get_code() const { return code_; };
 
+    //按内容类型设置Cache-Control，type可以是"image/png"、"image/*"或"*"，需在服务启动前设置
+    static void set_cache_control(const std::string& type, const std::string& value);
+    static bool load_cache_control(const std::string& rules);
+
 private:
-    void add_state_line(Buffer& buffer);
-    void add_header(Buffer& buffer);
-    void add_content(Buffer& buffer);
+    void add_state_line(HeaderWriter& writer);
+    void add_header(HeaderWriter& writer, std::string_view type = std::string_view());//type为空时按文件类型
+    void add_content(HeaderWriter& writer);
 
     void error_html();
-    std::string get_file_type();
+    std::string_view get_file_type() const;
+
+    bool is_not_modified();
+    size_t make_etag(char* dst, std::string_view suffix) const;
+    void add_validators(HeaderWriter& writer, std::string_view etag);
+    bool parse_range();
 
 private:
     int code_;
 
     bool is_keepalive_;
+    int keepalive_timeout_;//秒
+    int keepalive_max_;//此连接还能处理的请求数
+    int accept_encoding_;//HttpRequest::ACCEPT_ENCODING组合
 
     std::string path_;
     std::string src_dir_;//请求资源路径
     
-    char* mm_file_;//文件映射地址
-    struct stat mm_file_stat_;//映射文件的信息
+    struct stat file_stat_;//请求文件的信息
+
+    std::string if_none_match_;//条件请求，只对GET请求设置
+    std::string if_modified_since_;
+    std::string matched_etag_;//返回304时回显客户端持有的ETag
+
+    std::string range_;//Range请求头，只支持单个字节范围
+    std::string if_range_;
+    bool is_range_;
+    off_t range_begin_;
+    off_t range_end_;//包含
+
+    FileCache::EntryPtr entry_;//缓存的文件，发送完之前一直持有
+    const char* body_;
+    size_t body_len_;
+
+    //不在缓存中的大文件分段sendfile，不映射整个文件，每个连接占用的内存与文件大小无关
+    int file_fd_;
+    off_t file_offset_;
+    size_t file_remain_;
 
-    static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;//后缀类型
-    static const std::unordered_map<int, std::string> CODE_STATUS;//错误状态
     static const std::unordered_map<int, std::string> CODE_PATH;//错误代码页面路径
+    static std::unordered_map<std::string, std::string> CACHE_CONTROL;//内容类型对应的Cache-Control
+    static const size_t SEND_WINDOW = 1 << 20;//每次sendfile最多发送的字节数
+    static const size_t ETAG_SIZE = 64;
 };
 
 #endif // !__HTTPRESPONSE_H_
\ No newline at end of file
@@ -0,0 +1,193 @@
+/**
+
+ * @Date    :       2021-01-03
+*/
+
+#include "mimetype.h"
+#include <fstream>
+#include <sstream>
+#include <stdint.h>
+#include <assert.h>
+
+namespace {
+
+struct Builtin {
+    std::string_view ext;//小写，不含'.'
+    std::string_view type;
+};
+
+constexpr Builtin BUILTIN[] = {
+    { "html",  "text/html" },
+    { "htm",   "text/html" },
+    { "xml",   "text/xml" },
+    { "xhtml", "application/xhtml+xml" },
+    { "txt",   "text/plain" },
+    { "css",   "text/css" },
+    { "js",    "text/javascript" },
+    { "json",  "application/json" },
+    { "rtf",   "application/rtf" },
+    { "pdf",   "application/pdf" },
+    { "doc",   "application/msword" },
+    { "word",  "application/msword" },
+    { "png",   "image/png" },
+    { "gif",   "image/gif" },
+    { "jpg",   "image/jpeg" },
+    { "jpeg",  "image/jpeg" },
+    { "webp",  "image/webp" },
+    { "svg",   "image/svg+xml" },
+    { "ico",   "image/x-icon" },
+    { "woff",  "font/woff" },
+    { "woff2", "font/woff2" },
+    { "ttf",   "font/ttf" },
+    { "otf",   "font/otf" },
+    { "eot",   "application/vnd.ms-fontobject" },
+    { "au",    "audio/basic" },
+    { "mp3",   "audio/mpeg" },
+    { "mpeg",  "video/mpeg" },
+    { "mpg",   "video/mpeg" },
+    { "mp4",   "video/mp4" },
+    { "webm",  "video/webm" },
+    { "avi",   "video/x-msvideo" },
+    { "gz",    "application/x-gzip" },
+    { "tar",   "application/x-tar" },
+    { "wasm",  "application/wasm" },
+};
+
+constexpr size_t BUILTIN_NUM = sizeof(BUILTIN) / sizeof(BUILTIN[0]);
+constexpr size_t TABLE_SIZE = 256;//2的幂，约为条目数的8倍，容易找到无冲突的种子
+constexpr size_t MAX_EXT_LEN = 8;
+
+constexpr uint32_t hash(std::string_view s, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : s) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/**
+ * 编译期搜索使所有内置后缀落在不同槽位的种子
+*/
+constexpr uint32_t find_seed() {
+    for (uint32_t seed = 0; seed < 100000; seed++) {
+        bool used[TABLE_SIZE] = {};
+        bool ok = true;
+        for (size_t i = 0; i < BUILTIN_NUM && ok; i++) {
+            size_t slot = hash(BUILTIN[i].ext, seed) & (TABLE_SIZE - 1);
+            ok = !used[slot];
+            used[slot] = true;
+        }
+        if (ok) return seed;
+    }
+    return UINT32_MAX;
+}
+
+constexpr uint32_t SEED = find_seed();
+static_assert(SEED != UINT32_MAX, "no perfect hash seed for builtin mime types");
+
+struct Table {
+    uint8_t index[TABLE_SIZE];//BUILTIN下标+1，0为空槽
+};
+
+constexpr Table build_table() {
+    Table table = {};
+    for (size_t i = 0; i < BUILTIN_NUM; i++) {
+        table.index[hash(BUILTIN[i].ext, SEED) & (TABLE_SIZE - 1)] = static_cast<uint8_t>(i + 1);
+    }
+    return table;
+}
+
+constexpr Table TABLE = build_table();
+
+constexpr std::string_view lookup_builtin(std::string_view ext) {
+    uint8_t index = TABLE.index[hash(ext, SEED) & (TABLE_SIZE - 1)];
+    if (index && BUILTIN[index - 1].ext == ext) return BUILTIN[index - 1].type;
+    return std::string_view();
+}
+
+static_assert(lookup_builtin("css") == "text/css", "builtin mime table broken");
+
+}
+
+std::vector<MimeType::Extra> MimeType::extra_;
+
+/**
+ * 取路径的后缀转成小写后查询，没有后缀或未知后缀返回text/plain
+*/
+std::string_view MimeType::lookup(std::string_view path) {
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string_view::npos || path.size() - dot - 1 > MAX_EXT_LEN) return "text/plain";
+    if (path.find('/', dot) != std::string_view::npos) return "text/plain";
+
+    char lower[MAX_EXT_LEN];
+    size_t len = path.size() - dot - 1;
+    for (size_t i = 0; i < len; i++) {
+        char c = path[dot + 1 + i];
+        lower[i] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+    }
+    std::string_view ext(lower, len);
+
+    if (!extra_.empty()) {
+        std::string_view type = lookup_extra(ext);
+        if (!type.empty()) return type;
+    }
+    std::string_view type = lookup_builtin(ext);
+    return type.empty() ? "text/plain" : type;
+}
+
+/**
+ * 文本类内容值得压缩，图片、字体(woff自带压缩)、音视频和压缩包本身已经压缩过
+*/
+bool MimeType::is_compressible(std::string_view type) {
+    if (type.compare(0, 5, "text/") == 0) return true;
+    return type == "application/javascript" || type == "application/json"
+        || type == "application/xhtml+xml" || type == "application/rtf"
+        || type == "application/wasm" || type == "application/vnd.ms-fontobject"
+        || type == "image/svg+xml" || type == "image/x-icon"
+        || type == "font/ttf" || type == "font/otf";
+}
+
+std::string_view MimeType::lookup_extra(std::string_view ext) {
+    size_t mask = extra_.size() - 1;
+    for (size_t i = hash(ext, 0) & mask; !extra_[i].ext.empty(); i = (i + 1) & mask) {
+        if (extra_[i].ext == ext) return extra_[i].type;
+    }
+    return std::string_view();
+}
+
+/**
+ * 加载配置的类型，返回加载的条数，文件打不开返回-1
+ * 表的容量至少为条数的两倍，保证探测能遇到空槽
+ * 只能成功加载一次：lookup返回的类型指向表中的字符串，文件缓存条目会一直持有
+*/
+int MimeType::load(const char* path) {
+    assert(extra_.empty());
+    std::ifstream in(path);
+    if (!in) return -1;
+
+    std::vector<Extra> items;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        Extra item;
+        if (!(fields >> item.ext >> item.type) || item.ext[0] == '#') continue;
+        if (item.ext[0] == '.') item.ext.erase(0, 1);
+        if (item.ext.empty() || item.ext.size() > MAX_EXT_LEN) continue;
+        for (char& c : item.ext) {
+            if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+        }
+        items.push_back(item);
+    }
+
+    size_t capacity = 16;
+    while (capacity < items.size() * 2) capacity <<= 1;
+    std::vector<Extra> table(capacity);
+    for (const Extra& item : items) {
+        size_t i = hash(item.ext, 0) & (capacity - 1);
+        while (!table[i].ext.empty() && table[i].ext != item.ext) i = (i + 1) & (capacity - 1);
+        table[i] = item;//同一后缀后面的覆盖前面的
+    }
+    extra_.swap(table);
+    return static_cast<int>(items.size());
+}
@@ -0,0 +1,38 @@
+/**
+
+ * @Date    :       2021-01-03
+*/
+
+#ifndef __MIMETYPE_H_
+#define __MIMETYPE_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * 按文件后缀查询MIME类型
+ * 内置类型在编译期生成完美哈希表，查询不分配内存、不探测
+ * 启动时可以从配置文件追加或覆盖类型，加载后只读，配置的类型优先
+*/
+class MimeType {
+public:
+    static std::string_view lookup(std::string_view path);
+    static bool is_compressible(std::string_view type);
+
+    //配置文件每行为"后缀 类型"，如"md text/markdown"，#开头为注释，需在服务启动前调用且只能成功加载一次
+    static int load(const char* path);
+
+private:
+    struct Extra {
+        std::string ext;
+        std::string type;
+    };
+
+    static std::string_view lookup_extra(std::string_view ext);
+
+    //配置的类型，线性探测的开放寻址表，容量为2的幂
+    static std::vector<Extra> extra_;
+};
+
+#endif // !__MIMETYPE_H_
@@ -0,0 +1,62 @@
+/**
+
+ * @Date    :       2020-12-28
+*/
+
+#include "accesslog.h"
+
+//访问日志格式：ip:port 方法 路径 状态码 字节数 解析us 处理us 发送us
+static const char* ACCESS_FORMAT = "%s:%d %s %s %d %zu %ld %ld %ld";
+
+AccessLog::AccessLog() : sample_rate_(1), format_id_(-1), is_open_(false) {
+
+}
+
+/**
+ * 单例模式，全局实例化一个访问日志对象
+*/
+AccessLog* AccessLog::instance() {
+    static AccessLog inst;
+    return &inst;
+}
+
+/**
+ * 访问日志初始化
+ * 文件与运行日志放在同一目录，以.access.log结尾，按天和行数切分
+ * sample_rate：采样率，1为全部记录，N为每N个请求记录一个
+*/
+void AccessLog::init(const char* path, int sample_rate, int max_queue_capacity, Log::LOG_MODE mode) {
+    assert(sample_rate > 0 && max_queue_capacity > 0);
+    sample_rate_ = sample_rate;
+    log_.init(1, path, mode == Log::MODE_BINARY ? ".access.bin" : ".access.log",
+                max_queue_capacity, Log::OVERFLOW_DROP, 10, false, mode);
+    format_id_ = log_.register_format(ACCESS_FORMAT);
+    is_open_ = true;
+}
+
+/**
+ * 判断本次请求是否需要记录
+ * 每个线程独立计数，不需要原子操作
+*/
+bool AccessLog::sample() {
+    if (!is_open()) return false;
+    if (sample_rate_ == 1) return true;
+    static thread_local unsigned int counter = 0;
+    return counter++ % sample_rate_ == 0;
+}
+
+/**
+ * 记录一个请求
+*/
+void AccessLog::record(const char* ip, int port, const std::string& method, const std::string& path,
+                        int code, size_t bytes, long parse_us, long handle_us, long write_us) {
+    log_.write(1, format_id_, ACCESS_FORMAT, ip, port, method.c_str(), path.c_str(),
+                code, bytes, parse_us, handle_us, write_us);
+}
+
+/**
+ * 获取因队列满被丢弃的访问日志条数
+*/
+uint64_t AccessLog::get_dropped_count() const {
+    return log_.get_dropped_count();
+}
@@ -0,0 +1,42 @@
+/**
+
+ * @Date    :       2020-12-28
+*/
+
+#ifndef __ACCESSLOG_H_
+#define __ACCESSLOG_H_
+
+#include <atomic>
+#include <string>
+#include "log.h"
+
+/**
+ * 访问日志
+ * 每个请求一条紧凑记录：客户端 方法 路径 状态码 字节数 解析/处理/发送耗时(us)
+ * 使用独立的日志队列和写线程，队列满时直接丢弃，不影响请求线程
+*/
+class AccessLog {
+public:
+    static AccessLog* instance();
+
+    void init(const char* path = "./log", int sample_rate = 1,
+              int max_queue_capacity = 8192,
+              Log::LOG_MODE mode = Log::MODE_TEXT);
+    bool is_open() const { return is_open_.load(std::memory_order_relaxed); }
+    bool sample();
+    void record(const char* ip, int port, const std::string& method, const std::string& path,
+                int code, size_t bytes, long parse_us, long handle_us, long write_us);
+    uint64_t get_dropped_count() const;
+
+private:
+    AccessLog();
+    ~AccessLog() = default;
+
+private:
+    Log log_;
+    int sample_rate_;//每sample_rate_个请求记录一个
+    int format_id_;
+    std::atomic<bool> is_open_;
+};
+
+#endif // !__ACCESSLOG_H_
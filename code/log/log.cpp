@@ -4,90 +4,172 @@
 */
 
 #include "log.h"
-#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <ctype.h>
+#include <dirent.h>
+#include <zlib.h>
 
-Log::Log() {
+namespace {
+
+/**
+ * 线程私有的时间前缀缓存
+ * "YYYY-MM-DD HH:MM:SS"只在秒数变化时重新生成，
+ * 避免每条日志都调用localtime（内部持有全局时区锁）和snprintf
+*/
+struct TimeCache {
+    time_t sec;
+    int year;
+    int month;
+    int day;
+    char prefix[64];
+};
+
+const size_t TIME_PREFIX_LEN = 19;//"YYYY-MM-DD HH:MM:SS"的长度
+
+thread_local TimeCache time_cache = { -1, 0, 0, 0, {0} };
+
+const TimeCache& cached_time(time_t sec) {
+    TimeCache& cache = time_cache;
+    if (cache.sec != sec) {
+        struct tm t;
+        localtime_r(&sec, &t);
+        cache.sec = sec;
+        cache.year = t.tm_year + 1900;
+        cache.month = t.tm_mon + 1;
+        cache.day = t.tm_mday;
+        snprintf(cache.prefix, sizeof(cache.prefix), "%04d-%02d-%02d %02d:%02d:%02d",
+                cache.year, cache.month, cache.day, t.tm_hour, t.tm_min, t.tm_sec);
+    }
+    return cache;
+}
+
+/**
+ * 定宽6位十进制格式化微秒，不足补0
+*/
+inline void format_usec(char* dst, long usec) {
+    for (int i = 5; i >= 0; i--) {
+        dst[i] = static_cast<char>('0' + usec % 10);
+        usec /= 10;
+    }
+}
+
+}
+
+Log::Log() : is_open_(false), level_(1), stage_(FLUSH_BYTES), echo_stdout_(false), flush_requested_(false),
+        dropped_(0), is_closing_(false), writer_sleeping_(false) {
     line_count_ = 0;
+    file_bytes_ = 0;
     today_ = 0;
+    file_index_ = 0;
+    file_period_ = 0;
+    file_name_[0] = '\0';
 
     is_async_ = false;
+    policy_ = OVERFLOW_DROP;
     write_thread_ = nullptr;
 
-    deque_ = nullptr;
+    ring_ = nullptr;
+    dropped_reported_ = 0;
+
+    fd_ = -1;
+    flush_interval_ms_ = 1;
 
-    fp_ = nullptr;
+    //0号格式串保留给无法按参数记录的日志，先格式化成文本再记录
+    is_binary_ = false;
+    formats_.reset(new LogFormat[MAX_FORMATS]);
+    formats_[0].parse("%s");
+    format_count_ = 1;
+    formats_written_ = -1;
 }
 
 Log::~Log() {
     if (write_thread_ && write_thread_->joinable()) {
-        while (!deque_->empty()) {//让写日志线程吧缓存日志全部写完
-            deque_->flush();
-        }
-        deque_->close();
+        //让写日志线程把缓存日志全部写完再退出
+        is_closing_ = true;
+        notify_writer();
         write_thread_->join();
     }
-    if (fp_) {//关闭日志文件
+    if (fd_ >= 0) {//关闭日志文件
         std::lock_guard<std::mutex> lock(mtx_);
-        flush();
-        fclose(fp_);
+        flush_stage();
+        close(fd_);
     }
+    if (archive_thread_ && archive_thread_->joinable()) {
+        //空任务通知归档线程处理完已提交的旧文件后退出
+        archive_queue_->push_back(std::make_pair(std::string(), std::string()));
+        archive_thread_->join();
+    }
+}
+
+/**
+ * 设置日志切分、压缩和保留策略
+*/
+void Log::set_rotate_policy(const RotatePolicy& rotate) {
+    rotate_ = rotate;
 }
 
 /**
  * 日志系统初始化
- * 创建日环缓存队列
+ * 创建无锁环形缓存队列
  * 创建写日志线程
  * 打开日志文件
+ * flush_interval_ms：日志在写线程暂存区最长停留时间
+ * mode：MODE_BINARY时文件为二进制格式，需用logdecoder解码
 */
 void Log::init(int level, const char* path,
-                const char* suffix, int max_queue_capacity) {
-    is_open_ = true;//开启日志系统
+                const char* suffix, int max_queue_capacity,
+                OVERFLOW_POLICY policy, int flush_interval_ms,
+                bool echo_stdout, LOG_MODE mode) {
     level_ = level;//设置日志等级
-    //判断是否开启异步写日志
-    if (max_queue_capacity > 0) {
-        is_async_ = true;//开启异步写日志
-        //创建日志缓存队列
-        std::unique_ptr<BlockQueue<std::string>> new_queue(new BlockQueue<std::string>());
-        deque_ = std::move(new_queue);
-
-        //创建异步写日志线程
-        std::unique_ptr<std::thread> new_thread(new std::thread(flush_log_thread));
-        write_thread_ = std::move(new_thread);
-    }
-    else {
-        is_async_ = false;
-    }
-
-    line_count_ = 0;
+    is_binary_ = (mode == MODE_BINARY);
+    policy_ = policy;
+    flush_interval_ms_ = std::max(flush_interval_ms, 0);
+    echo_stdout_ = echo_stdout;
     
     //获取当前时间
     time_t timer = time(nullptr);
-    struct tm *sys_time = localtime(&timer);//将时间转化为年月日
-    struct tm t = *sys_time;//此处存在内存泄漏？？？？
+    struct tm t;
+    localtime_r(&timer, &t);//将时间转化为年月日
 
     path_ = path;//日志文件路径
     suffix_ = suffix;//日志文件后缀
-    char file_name[LOG_NAME_LEN] = {0};
-    snprintf(file_name, LOG_NAME_LEN-1, "%s/%04d_%02d_%02d%s",//log/年月日.log
-            path_, t.tm_year+1900, t.tm_mon+1, t.tm_mday, suffix_);
-    today_ = t.tm_mday;//标记当天
 
     {
-        //清空buffer，创建或打开日志文件
+        //创建或打开日志文件
         std::lock_guard<std::mutex> lock(mtx_);
-        buffer_.retrieve_all();
-
-        if (fp_) {
-            flush();
-            fclose(fp_);
+        if (fd_ >= 0) {
+            flush_stage();
+            close(fd_);
         }
-        fp_ = fopen(file_name, "a");
-        if (!fp_) {
-            mkdir(path_, 0777);
-            fp_ = fopen(file_name, "a");
-        }
-        assert(fp_);
+        file_index_ = 0;
+        bool ret = open_file(t.tm_year+1900, t.tm_mon+1, t.tm_mday, timer);
+        assert(ret);
+        (void)ret;
+        last_flush_ = std::chrono::steady_clock::now();
+    }
+
+    //需要压缩或清理旧文件时启动归档线程，启动时先按保留个数清理一次
+    if ((rotate_.compress || rotate_.max_files > 0) && !archive_thread_) {
+        archive_queue_.reset(new BlockQueue<std::pair<std::string, std::string>>(1024));
+        archive_thread_.reset(new std::thread(archive_thread, this));
+        archive_queue_->push_back(std::make_pair(std::string(), std::string(file_name_)));
+    }
+
+    //判断是否开启异步写日志，文件打开后再启动写线程
+    if (max_queue_capacity > 0 && !write_thread_) {
+        is_async_ = true;//开启异步写日志
+        //创建日志缓存队列，槽位一次性分配
+        ring_.reset(new RingQueue<LogRecord>(max_queue_capacity));
+
+        //创建异步写日志线程
+        std::unique_ptr<std::thread> new_thread(new std::thread(flush_log_thread, this));
+        write_thread_ = std::move(new_thread);
+    }
+    else if (max_queue_capacity <= 0) {
+        is_async_ = false;
     }
+    is_open_ = true;//开启日志系统
 }
 
 /**
@@ -103,19 +185,63 @@ Log* Log::instance() {
  * 线程任务函数
  * 这样写是为了在线程能够调用类函数
 */
-void Log::flush_log_thread() {
-    Log::instance()->ansync_write();
+void Log::flush_log_thread(Log* log) {
+    log->ansync_write();
 }
 
 /**
  * 异步写日志线程任务函数
+ * 批量取出已发布的日志记录追加到暂存区，
+ * 暂存区超过FLUSH_BYTES或停留超过flush_interval_ms_时一次性写入文件，
+ * 队列空时休眠到下一次刷新时间或被唤醒
 */
 void Log::ansync_write() {
-    std::string str = "";
-    while (deque_->pop(str)) {
-        std::lock_guard<std::mutex> lock(mtx_);
-        fputs(str.c_str(), fp_);
-        std::cout<< str << std::endl;
+    typedef std::chrono::steady_clock SteadyClock;
+    const auto interval = std::chrono::milliseconds(flush_interval_ms_);
+    while (true) {
+        size_t n = ring_->pop_batch([this](const LogRecord& record) {
+            write_record(record);
+        }, WRITE_BATCH);
+        report_dropped();
+
+        auto now = SteadyClock::now();
+        if (stage_.get_readable_bytes() >= FLUSH_BYTES || flush_requested_
+                || (stage_.get_readable_bytes() && now - last_flush_ >= interval)) {
+            flush_requested_ = false;
+            flush_stage();
+        }
+        if (n > 0) continue;
+
+        if (is_closing_) {//退出前保证队列已经取空
+            if (ring_->empty()) break;
+            std::this_thread::yield();
+            continue;
+        }
+
+        //暂存区有数据则最多睡到刷新时间，否则等待新日志
+        auto timeout = std::chrono::milliseconds(100);
+        if (stage_.get_readable_bytes()) {
+            timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        last_flush_ + interval - now) + std::chrono::milliseconds(1);
+        }
+        std::unique_lock<std::mutex> lock(wait_mtx_);
+        writer_sleeping_ = true;
+        cond_writer_.wait_for(lock, timeout, [this] {
+            return !ring_->empty() || is_closing_ || flush_requested_;
+        });
+        writer_sleeping_ = false;
+    }
+    flush_stage();
+}
+
+/**
+ * 唤醒休眠中的写线程
+ * 写线程忙时不会休眠，此时不需要加锁通知
+*/
+void Log::notify_writer() {
+    if (writer_sleeping_) {
+        std::lock_guard<std::mutex> lock(wait_mtx_);
+        cond_writer_.notify_one();
     }
 }
 
@@ -124,123 +250,436 @@ void Log::ansync_write() {
  * 日志格式：年月日 时间 日志等级 具体日志信息
 */
 void Log::write(int level, const char* format, ...) {
-    //获取当前时间
+    va_list args;
+    va_start(args, format);
+    vwrite(level, -1, format, args);
+    va_end(args);
+}
+
+/**
+ * 带格式串id写入日志，由日志宏调用
+ * 二进制模式下按id只记录参数，id无效时退化为先格式化成文本
+*/
+void Log::write(int level, int format_id, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vwrite(level, format_id, format, args);
+    va_end(args);
+}
+
+/**
+ * 异步模式下直接在环形队列槽位中格式化，不加锁
+*/
+void Log::vwrite(int level, int format_id, const char* format, va_list args) {
+    //获取当前时间，gettimeofday走vDSO不陷入内核
     struct timeval now = {0, 0};
     gettimeofday(&now, nullptr);
-    //转化为年月日
-    struct tm* sys_time = localtime(&now.tv_sec);
-    struct tm t = *sys_time;
-
-    //如果一个日志文件写满或过了一天则创建新的文件
-    if (today_ != t.tm_mday || (line_count_ && (line_count_ % MAX_LINES == 0))) {
-        std::unique_lock<std::mutex> lock(mtx_);//何必在此处拿锁？？？？？
-        lock.unlock();
-
-        char new_file_name[LOG_NAME_LEN];
-        char tail[36] = {0};
-        snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year+1900, t.tm_mon+1, t.tm_mday);
-
-        if (today_ != t.tm_mday) {
-            snprintf(new_file_name, LOG_NAME_LEN-72, "%s/%s%s", path_, tail, suffix_);
-            today_ = t.tm_mday;
-            line_count_ = 0;
-        }
-        else {
-            snprintf(new_file_name, LOG_NAME_LEN-72, "%s/%s-%d%s", 
-                    path_, tail, (line_count_/MAX_LINES), suffix_);
+
+    if (is_async_) {
+        auto fill = [&](LogRecord& record) {
+            format_record(record, level, now, format_id, format, args);
+        };
+        while (!ring_->try_push(fill)) {
+            if (policy_ == OVERFLOW_DROP) {//丢弃，由写线程汇报丢弃数量
+                dropped_++;
+                break;
+            }
+            notify_writer();//阻塞策略：等待写线程腾出空位
+            std::this_thread::yield();
         }
+        notify_writer();
+    }
+    else {
+        LogRecord record;
+        format_record(record, level, now, format_id, format, args);
+        std::lock_guard<std::mutex> lock(mtx_);
+        write_record(record);
+        flush_stage();
+    }
+}
+
+/**
+ * 登记调用点的格式串，返回格式串id
+ * 每个调用点只在第一次输出时调用一次，不支持的格式串返回-1
+*/
+int Log::register_format(const char* format) {
+    std::lock_guard<std::mutex> lock(format_mtx_);
+    int id = format_count_.load(std::memory_order_relaxed);
+    if (id >= MAX_FORMATS || !formats_[id].parse(format)) return -1;
+    format_count_.store(id+1, std::memory_order_release);
+    return id;
+}
+
+/**
+ * 按日志模式生成一条日志记录
+*/
+void Log::format_record(LogRecord& record, int level, const struct timeval& now,
+                        int format_id, const char* format, va_list args) {
+    const TimeCache& cache = cached_time(now.tv_sec);
+    record.sec = now.tv_sec;
+    record.year = cache.year;
+    record.month = cache.month;
+    record.day = cache.day;
+
+    if (is_binary_) encode_binary(record, level, now, format_id, format, args);
+    else format_text(record, level, now, format, args);
+}
+
+/**
+ * 格式化一条文本日志到定长记录，超长内容被截断
+*/
+void Log::format_text(LogRecord& record, int level, const struct timeval& now,
+                        const char* format, va_list args) {
+    const TimeCache& cache = cached_time(now.tv_sec);
+
+    //写入此条日志时间：缓存的秒级前缀+微秒
+    size_t len = TIME_PREFIX_LEN;
+    memcpy(record.data, cache.prefix, len);
+    record.data[len++] = '.';
+    format_usec(record.data+len, static_cast<long>(now.tv_usec));
+    len += 6;
+    record.data[len++] = ' ';
+
+    //添加日志等级
+    memcpy(record.data+len, LogFormat::level_title(level), 9);
+    len += 9;
+
+    //把日志内容添加，预留换行符的位置
+    int m = vsnprintf(record.data+len, LOG_RECORD_SIZE-len-1, format, args);
+    if (m > 0) len += std::min(static_cast<size_t>(m), LOG_RECORD_SIZE-len-2);
+    record.data[len++] = '\n';
+    record.len = len;
+}
 
-        //把旧日志写到已满文件然后关闭旧的日志文件
-        //然后打开新的日志文件
-        lock.lock();
-        flush();
-        fclose(fp_);
-        fp_ = fopen(new_file_name, "a");
-        assert(fp_);
+/**
+ * 编码一条二进制日志：固定头+原始参数字节，不做任何格式化
+ * 格式串未登记时先格式化成文本，按0号格式串"%s"记录
+*/
+void Log::encode_binary(LogRecord& record, int level, const struct timeval& now,
+                        int format_id, const char* format, va_list args) {
+    char* p = record.data + LogFormat::LOG_HEAD_LEN;
+    size_t space = LOG_RECORD_SIZE - LogFormat::LOG_HEAD_LEN;
+    if (format_id > 0 && format_id < format_count_.load(std::memory_order_acquire)) {
+        p += formats_[format_id].encode_args(p, space, args);
+    }
+    else {
+        char text[LOG_RECORD_SIZE];
+        int m = vsnprintf(text, sizeof(text), format, args);
+        uint16_t n = static_cast<uint16_t>(std::min(std::max(m, 0), static_cast<int>(space) - 2));
+        memcpy(p, &n, 2);
+        memcpy(p+2, text, n);
+        p += 2 + n;
+        format_id = 0;
     }
 
-    //正常情况直接写入日志消息
-    {
-        std::lock_guard<std::mutex> lock(mtx_);
-        line_count_++;
-
-        //写入此条日志时间
-        int n = snprintf(buffer_.get_begin_write_ptr(), 128, "%d-%02d-%02d %02d:%02d:%02d.%6ld",
-                        t.tm_year+1900, t.tm_mon+1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, now.tv_usec);
-        buffer_.has_written(n);
-        append_log_level_title(level);//添加日志等级
-
-        //解析可变参数
-        va_list args;
-        va_start(args, format);
-        //把日志内容添加
-        int m = vsnprintf(buffer_.get_begin_write_ptr(), buffer_.get_writable_bytes(), format, args);
-        va_end(args);
-        buffer_.has_written(m);
-
-        buffer_.append("\n\0", 2);
-
-        //写入日志
-        if (is_async_) {
-            deque_->push_back(buffer_.retrieve_all_tostr());
+    uint16_t len = static_cast<uint16_t>(p - record.data);
+    uint32_t id = static_cast<uint32_t>(format_id);
+    int64_t sec = now.tv_sec;
+    int32_t usec = static_cast<int32_t>(now.tv_usec);
+    char* head = record.data;
+    *head++ = LogFormat::ENTRY_LOG;
+    memcpy(head, &len, 2);
+    memcpy(head+2, &id, 4);
+    head[6] = static_cast<char>(level);
+    memcpy(head+7, &sec, 8);
+    memcpy(head+15, &usec, 4);
+    record.len = len;
+}
+
+/**
+ * 写线程内部生成一条日志记录
+*/
+void Log::fill_record(LogRecord& record, int level, const char* format, ...) {
+    struct timeval now = {0, 0};
+    gettimeofday(&now, nullptr);
+    va_list args;
+    va_start(args, format);
+    format_record(record, level, now, -1, format, args);
+    va_end(args);
+}
+
+/**
+ * 把一条日志追加到暂存区
+ * 如果当前文件达到切分条件则先切换到新文件
+ * 异步模式下只有写线程调用，同步模式下调用者持有mtx_
+*/
+void Log::write_record(const LogRecord& record) {
+    if (need_rotate(record)) rotate(record);
+
+    size_t before = stage_.get_readable_bytes();
+    if (is_binary_) append_binary_dictionary();
+    stage_.append(record.data, record.len);
+    file_bytes_ += stage_.get_readable_bytes() - before;
+    line_count_++;
+}
+
+/**
+ * 判断写入这条日志前是否需要切换文件：跨天、行数、大小或时间段
+*/
+bool Log::need_rotate(const LogRecord& record) const {
+    if (today_ != record.day) return true;
+    if (line_count_ == 0) return false;//空文件不切分，避免单条超限日志反复切换
+    if (rotate_.max_lines > 0 && line_count_ >= rotate_.max_lines) return true;
+    if (rotate_.max_bytes > 0 && file_bytes_ + record.len > rotate_.max_bytes) return true;
+    if (rotate_.interval_sec > 0 && record.sec / rotate_.interval_sec != file_period_) return true;
+    return false;
+}
+
+/**
+ * 把暂存区写入旧文件后关闭，打开新的日志文件
+ * 旧文件交给归档线程压缩和清理，写线程不做这些耗时的文件操作
+*/
+void Log::rotate(const LogRecord& record) {
+    flush_stage();
+    std::string old_name(file_name_);
+
+    file_index_ = (today_ != record.day) ? 0 : file_index_ + 1;
+    int old_fd = fd_;
+    if (!open_file(record.year, record.month, record.day, record.sec)) {
+        fd_ = old_fd;//新文件打不开则继续写旧文件
+        return;
+    }
+    close(old_fd);
+    if (archive_queue_) archive_queue_->push_back(std::make_pair(old_name, std::string(file_name_)));
+}
+
+/**
+ * 打开file_index_对应的日志文件：log/年_月_日[-序号]后缀
+ * 跳过已经被压缩过的序号，文件已存在时追加写并接着统计大小
+*/
+bool Log::open_file(int year, int month, int day, time_t sec) {
+    char file_name[LOG_NAME_LEN];
+    char archived[LOG_NAME_LEN+4];
+    while (true) {
+        if (file_index_ == 0) {
+            snprintf(file_name, LOG_NAME_LEN, "%s/%04d_%02d_%02d%s",
+                    path_.c_str(), year, month, day, suffix_.c_str());
         }
         else {
-            fputs(buffer_.peek(), fp_);//此处是否有bug？？？？
+            snprintf(file_name, LOG_NAME_LEN, "%s/%04d_%02d_%02d-%d%s",
+                    path_.c_str(), year, month, day, file_index_, suffix_.c_str());
         }
-        buffer_.retrieve_all();
+        snprintf(archived, sizeof(archived), "%s.gz", file_name);
+        if (access(archived, F_OK) != 0) break;
+        file_index_++;
     }
+
+    int fd = open(file_name, O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC, 0644);
+    if (fd < 0) {
+        mkdir(path_.c_str(), 0777);
+        fd = open(file_name, O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC, 0644);
+    }
+    if (fd < 0) return false;
+
+    struct stat st;
+    fd_ = fd;
+    file_bytes_ = (fstat(fd, &st) == 0) ? static_cast<size_t>(st.st_size) : 0;
+    line_count_ = 0;
+    today_ = day;
+    file_period_ = rotate_.interval_sec > 0 ? sec / rotate_.interval_sec : 0;
+    snprintf(file_name_, LOG_NAME_LEN, "%s", file_name);
+    formats_written_ = -1;
+    return true;
 }
 
 /**
- * 通知线程写日志到文件
+ * 归档线程任务函数
 */
-void Log::flush() {
-    if (is_async_) deque_->flush();
-    fflush(fp_);
+void Log::archive_thread(Log* log) {
+    log->archive_loop();
 }
 
 /**
- * 设置日志等级
+ * 依次处理切出的旧文件：按需压缩，再按保留个数删除最旧的文件
+ * 收到文件名都为空的任务时退出
 */
-void Log::set_level(int level) {
-    std::lock_guard<std::mutex> lock(mtx_);
-    level_ = level;
+void Log::archive_loop() {
+    std::pair<std::string, std::string> item;
+    while (archive_queue_->pop(item)) {
+        if (item.first.empty() && item.second.empty()) break;
+        if (!item.first.empty() && rotate_.compress) compress_file(item.first);
+        if (rotate_.max_files > 0) remove_expired(item.second);
+    }
 }
 
 /**
- * 获取日志等级
+ * gzip压缩一个旧日志文件
+ * 先写临时文件再改名，成功后删除原文件，失败时保留原文件
 */
-int Log::get_level() {
-    std::lock_guard<std::mutex> lock(mtx_);
-    return level_;
+void Log::compress_file(const std::string& file_name) {
+    int fd = open(file_name.c_str(), O_RDONLY|O_CLOEXEC);
+    if (fd < 0) return;
+
+    std::string tmp_name = file_name + ".gz.tmp";
+    gzFile gz = gzopen(tmp_name.c_str(), "wb6");
+    if (!gz) {
+        close(fd);
+        return;
+    }
+
+    bool ok = true;
+    char buff[64*1024];
+    ssize_t n;
+    while ((n = read(fd, buff, sizeof(buff))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        if (gzwrite(gz, buff, static_cast<unsigned>(n)) != n) {
+            ok = false;
+            break;
+        }
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) ok = false;
+    close(fd);
+    if (gzclose(gz) != Z_OK) ok = false;
+
+    //压缩文件沿用原文件的修改时间，清理时按时间排序才能反映日志的先后
+    if (ok) {
+        struct timespec times[2] = { st.st_atim, st.st_mtim };
+        utimensat(AT_FDCWD, tmp_name.c_str(), times, 0);
+    }
+    if (ok && rename(tmp_name.c_str(), (file_name + ".gz").c_str()) == 0) {
+        unlink(file_name.c_str());
+    }
+    else {
+        unlink(tmp_name.c_str());
+    }
 }
 
 /**
- * 获取是否开启日志系统
+ * 判断目录项是否为本日志的文件：年_月_日[-序号]后缀[.gz]
 */
-bool Log::is_open() {
-    return is_open_;
+bool Log::is_log_file(const char* name) const {
+    const char* pattern = "dddd_dd_dd";
+    for (const char* p = pattern; *p; p++, name++) {
+        if (*p == 'd' ? !isdigit(static_cast<unsigned char>(*name)) : *name != *p) return false;
+    }
+    if (*name == '-') {
+        name++;
+        if (!isdigit(static_cast<unsigned char>(*name))) return false;
+        while (isdigit(static_cast<unsigned char>(*name))) name++;
+    }
+    size_t len = suffix_.size();
+    if (strncmp(name, suffix_.c_str(), len) != 0) return false;
+    name += len;
+    return *name == '\0' || strcmp(name, ".gz") == 0;
 }
 
 /**
- * 添加日志等级
+ * 只保留最新的max_files个旧文件，当前正在写的文件不计入也不删除
 */
-void Log::append_log_level_title(int level) {
-    switch(level) {
-    case 0:
-        buffer_.append("[debug]: ", 9);
-        break;
-    case 1:
-        buffer_.append("[info] : ", 9);
-        break;
-    case 2:
-        buffer_.append("[warn] : ", 9);
-        break;
-    case 3:
-        buffer_.append("[error]: ", 9);
-        break;
-    default:
-        buffer_.append("[info] : ", 9);
-        break;
+void Log::remove_expired(const std::string& current) {
+    DIR* dir = opendir(path_.c_str());
+    if (!dir) return;
+
+    std::vector<std::pair<int64_t, std::string>> files;//按修改时间排序，同一秒内切出的文件也能区分先后
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (!is_log_file(entry->d_name)) continue;
+        std::string name = path_ + "/" + entry->d_name;
+        struct stat st;
+        if (name == current || stat(name.c_str(), &st) != 0) continue;
+        int64_t mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        files.push_back(std::make_pair(mtime, name));
+    }
+    closedir(dir);
+
+    if (files.size() <= static_cast<size_t>(rotate_.max_files)) return;
+    std::sort(files.begin(), files.end());
+    size_t expired = files.size() - rotate_.max_files;
+    for (size_t i = 0; i < expired; i++) {
+        unlink(files[i].second.c_str());
     }
+}
+
+/**
+ * 二进制模式下每个新文件先写魔数，再补齐尚未写入本文件的格式串定义，
+ * 保证每个文件都能单独解码
+*/
+void Log::append_binary_dictionary() {
+    if (formats_written_ < 0) {
+        char head = LogFormat::ENTRY_HEADER;
+        stage_.append(&head, 1);
+        stage_.append(LogFormat::MAGIC, sizeof(LogFormat::MAGIC));
+        formats_written_ = 0;
+    }
+    int count = format_count_.load(std::memory_order_acquire);
+    for (; formats_written_ < count; formats_written_++) {
+        const char* format = formats_[formats_written_].get_format();
+        uint32_t id = static_cast<uint32_t>(formats_written_);
+        uint16_t len = static_cast<uint16_t>(std::min(strlen(format), static_cast<size_t>(UINT16_MAX)));
+        char head[7];
+        head[0] = LogFormat::ENTRY_FORMAT;
+        memcpy(head+1, &id, 4);
+        memcpy(head+5, &len, 2);
+        stage_.append(head, sizeof(head));
+        stage_.append(format, len);
+    }
+}
+
+/**
+ * 暂存区内容一次性写入日志文件，开启回显时同时写到标准输出
+ * 写文件出错时丢弃本批内容，避免写线程卡死
+*/
+void Log::flush_stage() {
+    last_flush_ = std::chrono::steady_clock::now();
+    if (stage_.get_readable_bytes() == 0) return;
+
+    if (echo_stdout_ && !is_binary_) {
+        ssize_t ret = ::write(STDOUT_FILENO, stage_.peek(), stage_.get_readable_bytes());
+        (void)ret;
+    }
+    while (stage_.get_readable_bytes()) {
+        int error = 0;
+        if (stage_.write_to_fd(fd_, &error) < 0 && error != EINTR) break;
+    }
+    stage_.retrieve(stage_.get_readable_bytes());
+}
+
+/**
+ * 汇报因队列满被丢弃的日志数量
+*/
+void Log::report_dropped() {
+    uint64_t dropped = dropped_;
+    if (dropped == dropped_reported_) return;
+
+    LogRecord record;
+    fill_record(record, 2, "log queue full, %llu messages dropped",
+                static_cast<unsigned long long>(dropped - dropped_reported_));
+    write_record(record);
+    dropped_reported_ = dropped;
+}
+
+/**
+ * 要求写线程立即把暂存的日志写到文件
+ * 同步模式下每条日志已经直接写入文件
+*/
+void Log::flush() {
+    if (!is_async_) return;
+    flush_requested_ = true;
+    notify_writer();
+}
+
+/**
+ * 设置是否回显日志到标准输出
+*/
+void Log::set_echo_stdout(bool echo) {
+    echo_stdout_ = echo;
+}
+
+/**
+ * 设置日志等级，运行期可随时调整
+*/
+void Log::set_level(int level) {
+    level_.store(level, std::memory_order_relaxed);
+}
+
+/**
+ * 获取被丢弃的日志条数
+*/
+uint64_t Log::get_dropped_count() const {
+    return dropped_;
 }
\ No newline at end of file
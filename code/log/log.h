@@ -10,71 +10,202 @@
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <string>
+#include <condition_variable>
+#include <utility>
 #include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/time.h>
 #include <sys/stat.h>
+#include "ringqueue.h"
 #include "blockqueue.h"
+#include "logformat.h"
 #include "../buffer/buffer.h"
 
 
+static const int LOG_RECORD_SIZE = 1024;//单条日志最大长度，超出截断
+
+/**
+ * 定长日志记录，生产者直接在环形队列槽位中格式化
+ * 二进制模式下data中是一个LogFormat::ENTRY_LOG条目
+*/
+struct LogRecord {
+    time_t sec;//日志产生的时间，写线程据此按时间切分文件
+    int year;//日志产生的日期，写线程据此按天切分文件
+    int month;
+    int day;
+    size_t len;
+    char data[LOG_RECORD_SIZE];
+};
+
 class Log {
 public:
+    //异步队列满时的处理策略
+    enum OVERFLOW_POLICY {
+        OVERFLOW_DROP,//丢弃并计数，生产者永不阻塞
+        OVERFLOW_BLOCK,//等待写线程腾出空位
+    };
+
+    //日志文件格式
+    enum LOG_MODE {
+        MODE_TEXT,//调用点格式化成文本
+        MODE_BINARY,//只记录格式串id和参数字节，用logdecoder离线还原
+    };
+
+    //日志切分策略，任一条件满足即切换到新文件，跨天总是切分
+    //切分只在写线程进行，压缩和清理在后台归档线程进行
+    struct RotatePolicy {
+        size_t max_bytes = 64 * 1024 * 1024;//单个文件最大字节数，0为不限
+        int max_lines = 50000;//单个文件最大行数，0为不限
+        int interval_sec = 0;//按时间切分的间隔(秒)，按整点对齐，0为不按时间切分
+        bool compress = false;//切出的旧文件是否gzip压缩
+        int max_files = 0;//目录中保留的旧文件个数，0为不清理
+    };
+
     void init(int level, const char *path = "./log", 
                 const char* suffix = ".log",
-                int max_queue_capacity = 1024);
+                int max_queue_capacity = 1024,
+                OVERFLOW_POLICY policy = OVERFLOW_DROP,
+                int flush_interval_ms = 1,
+                bool echo_stdout = false,
+                LOG_MODE mode = MODE_TEXT);
     static Log* instance();
-    static void flush_log_thread();
+    void set_rotate_policy(const RotatePolicy& rotate);//需在init之前调用
+    static void flush_log_thread(Log* log);
 
     void write(int leve, const char* format, ...);
+    void write(int level, int format_id, const char* format, ...);
+    int register_format(const char* format);
     void flush();
 
+    void set_echo_stdout(bool echo);
     void set_level(int level);
-    int get_level();
-    bool is_open();
+    //日志宏每次调用都会检查，无锁读取
+    int get_level() const { return level_.load(std::memory_order_relaxed); }
+    bool is_open() const { return is_open_.load(std::memory_order_relaxed); }
+    uint64_t get_dropped_count() const;
 
 private:
+    friend class AccessLog;//访问日志是独立的一路日志，拥有自己的Log实例
+
     Log();//私有化构造
-    void append_log_level_title(int level);//追加日志等级
     ~Log();//私有化析构
     void ansync_write();//异步写
+    void format_record(LogRecord& record, int level, const struct timeval& now,
+                        int format_id, const char* format, va_list args);
+    void format_text(LogRecord& record, int level, const struct timeval& now,
+                        const char* format, va_list args);
+    void encode_binary(LogRecord& record, int level, const struct timeval& now,
+                        int format_id, const char* format, va_list args);
+    void fill_record(LogRecord& record, int level, const char* format, ...);
+    void vwrite(int level, int format_id, const char* format, va_list args);
+    void append_binary_dictionary();//新文件写入魔数和格式串定义
+    bool need_rotate(const LogRecord& record) const;
+    bool open_file(int year, int month, int day, time_t sec);
+    void rotate(const LogRecord& record);
+    static void archive_thread(Log* log);
+    void archive_loop();//后台压缩和清理旧日志
+    void compress_file(const std::string& file_name);
+    void remove_expired(const std::string& current);
+    bool is_log_file(const char* name) const;
+    void write_record(const LogRecord& record);//追加到暂存区，必要时切分文件
+    void flush_stage();//暂存区一次性写入文件
+    void report_dropped();
+    void notify_writer();
 
 private:
     static const int LOG_PATH_LEN = 256;//日志路径
     static const int LOG_NAME_LEN = 256;//日志文件名长度
-    static const int MAX_LINES = 50000;//每个日志最大行
+    static const int WRITE_BATCH = 256;//写线程每批最多取出的日志条数
+    static const size_t FLUSH_BYTES = 64 * 1024;//暂存区超过此大小立即写文件
+    static const int MAX_FORMATS = 4096;//二进制模式最多登记的格式串个数
     
-    const char* path_;//日志文件路径
-    const char* suffix_;//日志文件后缀
+    std::string path_;//日志文件路径，保存副本，调用者的字符串可能在之后被释放
+    std::string suffix_;//日志文件后缀
 
-    int line_count_;//日志当前行数
+    int line_count_;//当前文件行数
+    size_t file_bytes_;//当前文件字节数
     int today_;//标记当天，同一天的日志后缀1,2,3....
+    int file_index_;//当天第几个文件
+    time_t file_period_;//按时间切分时当前文件所属的时间段
+    char file_name_[LOG_NAME_LEN];//当前文件名
+    RotatePolicy rotate_;
 
-    bool is_open_;//是否打开日志系统
+    //切出的旧文件名和当前文件名，交给归档线程压缩和清理
+    std::unique_ptr<BlockQueue<std::pair<std::string, std::string>>> archive_queue_;
+    std::unique_ptr<std::thread> archive_thread_;
 
-    Buffer buffer_;//要输出的日志内容
-    int level_;//日志输出限制等级
-    bool is_async_;//是否开启异步写日志
+    std::atomic<bool> is_open_;//是否打开日志系统
 
-    FILE* fp_;//日志文件
-    std::unique_ptr<BlockQueue<std::string>> deque_;//阻塞缓存日志消息
-    std::mutex mtx_;//日志队列锁
+    std::atomic<int> level_;//日志输出限制等级
+    bool is_async_;//是否开启异步写日志
+    OVERFLOW_POLICY policy_;//队列满时的处理策略
+
+    int fd_;//日志文件
+    Buffer stage_;//写线程暂存区，攒够一批再调用一次write()
+    int flush_interval_ms_;//暂存区最长停留时间
+    std::chrono::steady_clock::time_point last_flush_;//上次写文件的时间
+    std::atomic<bool> echo_stdout_;//是否同时输出到标准输出
+    std::atomic<bool> flush_requested_;//调用者要求立即写文件
+
+    bool is_binary_;//是否二进制日志
+    std::unique_ptr<LogFormat[]> formats_;//调用点登记的格式串，下标即格式串id
+    std::atomic<int> format_count_;
+    std::mutex format_mtx_;
+    int formats_written_;//当前文件已写入定义的格式串个数，-1表示还未写魔数
+    std::unique_ptr<RingQueue<LogRecord>> ring_;//无锁缓存日志记录
+    std::mutex mtx_;//同步写和文件切换锁
     std::unique_ptr<std::thread> write_thread_;//写日志线程
+
+    std::atomic<uint64_t> dropped_;//队列满被丢弃的日志条数
+    uint64_t dropped_reported_;//写线程已经报告过的丢弃条数
+    std::atomic<bool> is_closing_;//通知写线程退出
+    std::atomic<bool> writer_sleeping_;//写线程是否在等待新日志
+    std::mutex wait_mtx_;
+    std::condition_variable cond_writer_;
 };
 
+//编译期最低日志等级，低于此等级的日志语句在预处理阶段整体去掉
+//例如 -DLOG_MIN_LEVEL=1 去掉所有LOG_DEBUG，参数也不会被求值
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+//运行期等级不满足时不会调用write，格式化参数也不会被求值
+//每个调用点第一次输出时登记格式串，二进制模式据此只记录参数
 #define LOG_BASE(level, format, ...) \
     do {\
         Log* log = Log::instance();\
         if (log->is_open() && log->get_level() <= level) {\
-            log->write(level, format, ##__VA_ARGS__); \
-            log->flush();\
+            static const int log_format_id = log->register_format(format);\
+            log->write(level, log_format_id, format, ##__VA_ARGS__); \
         }\
     } while(0);
 
+#if LOG_MIN_LEVEL <= 0
 #define LOG_DEBUG(format, ...) do {LOG_BASE(0, format, ##__VA_ARGS__)} while(0);
+#else
+#define LOG_DEBUG(format, ...) do {} while(0);
+#endif
+
+#if LOG_MIN_LEVEL <= 1
 #define LOG_INFO(format, ...) do {LOG_BASE(1, format, ##__VA_ARGS__)} while(0);
+#else
+#define LOG_INFO(format, ...) do {} while(0);
+#endif
+
+#if LOG_MIN_LEVEL <= 2
 #define LOG_WARN(format, ...) do {LOG_BASE(2, format, ##__VA_ARGS__)} while(0);
-#define LOG_ERROR(format, ...) do {LOG_BASE(3, format, ##__VA_ARGS__)} while(0);
+#else
+#define LOG_WARN(format, ...) do {} while(0);
+#endif
 
+#if LOG_MIN_LEVEL <= 3
+#define LOG_ERROR(format, ...) do {LOG_BASE(3, format, ##__VA_ARGS__)} while(0);
+#else
+#define LOG_ERROR(format, ...) do {} while(0);
+#endif
 
 #endif // !__LOG_H_
\ No newline at end of file
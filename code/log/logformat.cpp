@@ -0,0 +1,262 @@
+/**
+
+ * @Date    :       2020-12-27
+*/
+
+#include "logformat.h"
+#include <algorithm>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+const char LogFormat::MAGIC[8] = { 'T', 'L', 'O', 'G', 'B', 'I', 'N', '1' };
+
+LogFormat::LogFormat() : format_(nullptr), arg_count_(0) {
+
+}
+
+/**
+ * 获取日志等级标题，文本日志和解码器共用
+*/
+const char* LogFormat::level_title(int level) {
+    static const char* LEVEL_TITLE[] = {
+        "[debug]: ", "[info] : ", "[warn] : ", "[error]: ",
+    };
+    return (level >= 0 && level <= 3) ? LEVEL_TITLE[level] : LEVEL_TITLE[1];
+}
+
+/**
+ * 解析从'%'之后开始的一个转换说明
+ * stars：宽度和精度中'*'的个数，每个'*'对应一个int参数
+ * 返回转换字符之后的位置，不支持的转换返回nullptr
+*/
+const char* LogFormat::scan_spec(const char* p, int* stars, int* type, bool* long_long) {
+    *stars = 0;
+    *long_long = false;
+    while (*p && strchr("-+ #0", *p)) p++;
+    if (*p == '*') {
+        (*stars)++;
+        p++;
+    }
+    else {
+        while (isdigit(static_cast<unsigned char>(*p))) p++;
+    }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            (*stars)++;
+            p++;
+        }
+        else {
+            while (isdigit(static_cast<unsigned char>(*p))) p++;
+        }
+    }
+
+    int longs = 0;
+    bool wide = false;
+    bool long_double = false;
+    while (*p && strchr("hlLqjzt", *p)) {
+        if (*p == 'l') longs++;
+        else if (*p == 'L') long_double = true;
+        else if (*p != 'h') wide = true;
+        p++;
+    }
+    *long_long = (longs >= 2);
+
+    switch (*p) {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+            *type = (longs || wide) ? ARG_INT64 : ARG_INT32;
+            break;
+        case 'c':
+            if (longs) return nullptr;
+            *type = ARG_INT32;
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            if (long_double) return nullptr;
+            *type = ARG_DOUBLE;
+            break;
+        case 's':
+            if (longs) return nullptr;
+            *type = ARG_STRING;
+            break;
+        case 'p':
+            *type = ARG_POINTER;
+            break;
+        default://%n等不支持
+            return nullptr;
+    }
+    return p + 1;
+}
+
+/**
+ * 解析格式串得到参数类型列表
+ * 含不支持的转换或参数过多时返回false，调用者改为先格式化成文本再记录
+*/
+bool LogFormat::parse(const char* format) {
+    format_ = format;
+    arg_count_ = 0;
+    if (!format) return false;
+
+    const char* p = format;
+    while (*p) {
+        if (*p++ != '%') continue;
+        if (*p == '%') {
+            p++;
+            continue;
+        }
+        int stars, type;
+        bool long_long;
+        p = scan_spec(p, &stars, &type, &long_long);
+        if (!p || arg_count_ + stars + 1 > MAX_ARGS) return false;
+        for (int i = 0; i < stars; i++) arg_types_[arg_count_++] = ARG_INT32;
+        arg_types_[arg_count_++] = static_cast<unsigned char>(type);
+    }
+    return true;
+}
+
+/**
+ * 按参数类型从va_list取出参数，原样写入dst
+ * 字符串超出剩余空间时截断，返回写入的字节数
+*/
+size_t LogFormat::encode_args(char* dst, size_t size, va_list args) const {
+    char* p = dst;
+    char* end = dst + size;
+    for (int i = 0; i < arg_count_; i++) {
+        switch (arg_types_[i]) {
+            case ARG_INT32: {
+                int32_t v = va_arg(args, int);
+                if (end - p < 4) return p - dst;
+                memcpy(p, &v, 4);
+                p += 4;
+                break;
+            }
+            case ARG_INT64: {//LP64下long/long long/size_t传参方式相同
+                int64_t v = va_arg(args, long long);
+                if (end - p < 8) return p - dst;
+                memcpy(p, &v, 8);
+                p += 8;
+                break;
+            }
+            case ARG_DOUBLE: {
+                double v = va_arg(args, double);
+                if (end - p < 8) return p - dst;
+                memcpy(p, &v, 8);
+                p += 8;
+                break;
+            }
+            case ARG_POINTER: {
+                uint64_t v = reinterpret_cast<uintptr_t>(va_arg(args, void*));
+                if (end - p < 8) return p - dst;
+                memcpy(p, &v, 8);
+                p += 8;
+                break;
+            }
+            case ARG_STRING: {
+                const char* s = va_arg(args, const char*);
+                if (!s) s = "(null)";
+                if (end - p < 2) return p - dst;
+                size_t len = strlen(s);
+                if (len > static_cast<size_t>(end - p - 2)) len = end - p - 2;
+                uint16_t n = static_cast<uint16_t>(len);
+                memcpy(p, &n, 2);
+                memcpy(p+2, s, n);
+                p += 2 + n;
+                break;
+            }
+        }
+    }
+    return p - dst;
+}
+
+/**
+ * 逐个转换说明调用snprintf还原一条日志内容
+*/
+template<class T>
+static void render_one(std::string& out, const std::string& spec, int stars, const int* star, T value) {
+    char buff[512];
+    int n;
+    if (stars == 0) n = snprintf(buff, sizeof(buff), spec.c_str(), value);
+    else if (stars == 1) n = snprintf(buff, sizeof(buff), spec.c_str(), star[0], value);
+    else n = snprintf(buff, sizeof(buff), spec.c_str(), star[0], star[1], value);
+    if (n > 0) out.append(buff, std::min(static_cast<size_t>(n), sizeof(buff)-1));
+}
+
+/**
+ * 用记录的参数字节把格式串还原成文本追加到out
+ * 参数字节不完整时返回false
+*/
+bool LogFormat::render(const char* data, size_t len, std::string& out) const {
+    const char* end = data + len;
+    const char* p = format_;
+    while (*p) {
+        if (*p != '%') {
+            out.push_back(*p++);
+            continue;
+        }
+        const char* spec_begin = p++;
+        if (*p == '%') {
+            out.push_back('%');
+            p++;
+            continue;
+        }
+        int stars, type;
+        bool long_long;
+        p = scan_spec(p, &stars, &type, &long_long);
+        if (!p) return false;
+        std::string spec(spec_begin, p);
+
+        int star[2] = {0, 0};
+        for (int i = 0; i < stars; i++) {
+            if (end - data < 4) return false;
+            memcpy(&star[i], data, 4);
+            data += 4;
+        }
+        switch (type) {
+            case ARG_INT32: {
+                int32_t v;
+                if (end - data < 4) return false;
+                memcpy(&v, data, 4);
+                data += 4;
+                render_one(out, spec, stars, star, static_cast<int>(v));
+                break;
+            }
+            case ARG_INT64: {
+                int64_t v;
+                if (end - data < 8) return false;
+                memcpy(&v, data, 8);
+                data += 8;
+                if (long_long) render_one(out, spec, stars, star, static_cast<long long>(v));
+                else render_one(out, spec, stars, star, static_cast<long>(v));
+                break;
+            }
+            case ARG_DOUBLE: {
+                double v;
+                if (end - data < 8) return false;
+                memcpy(&v, data, 8);
+                data += 8;
+                render_one(out, spec, stars, star, v);
+                break;
+            }
+            case ARG_POINTER: {
+                uint64_t v;
+                if (end - data < 8) return false;
+                memcpy(&v, data, 8);
+                data += 8;
+                render_one(out, spec, stars, star, reinterpret_cast<void*>(static_cast<uintptr_t>(v)));
+                break;
+            }
+            case ARG_STRING: {
+                uint16_t n;
+                if (end - data < 2) return false;
+                memcpy(&n, data, 2);
+                data += 2;
+                if (end - data < n) return false;
+                std::string s(data, n);
+                data += n;
+                render_one(out, spec, stars, star, s.c_str());
+                break;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,65 @@
+/**
+
+ * @Date    :       2020-12-27
+*/
+
+#ifndef __LOGFORMAT_H_
+#define __LOGFORMAT_H_
+
+#include <string>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 二进制日志的格式串描述
+ * 调用点只记录格式串id和原始参数字节，离线解码时再按格式串还原成文本
+ *
+ * 文件由以下条目依次组成，整数均为本机字节序：
+ *   'H' + 8字节魔数                      进程启动或新文件开始，解码器据此清空格式字典
+ *   'F' u32 id, u16 len, 格式串           格式串定义，同一文件中先于引用它的日志出现
+ *   'L' u16 条目总长, u32 id, u8 等级,
+ *       i64 秒, i32 微秒, 参数字节         一条日志
+ * 参数字节：整数4/8字节，浮点8字节，指针8字节，字符串为u16长度+内容
+*/
+class LogFormat {
+public:
+    enum ARG_TYPE {
+        ARG_INT32,//int及更短的整数，char
+        ARG_INT64,//long, long long, size_t
+        ARG_DOUBLE,
+        ARG_STRING,
+        ARG_POINTER,
+    };
+
+    enum ENTRY_KIND {
+        ENTRY_HEADER = 'H',
+        ENTRY_FORMAT = 'F',
+        ENTRY_LOG = 'L',
+    };
+
+    static const int MAX_ARGS = 16;//单个格式串最多参数个数
+    static const char MAGIC[8];
+    static const size_t LOG_HEAD_LEN = 1 + 2 + 4 + 1 + 8 + 4;//日志条目固定头长度
+
+    LogFormat();
+
+    bool parse(const char* format);
+    const char* get_format() const { return format_; }
+    int get_arg_count() const { return arg_count_; }
+
+    size_t encode_args(char* dst, size_t size, va_list args) const;
+    bool render(const char* data, size_t len, std::string& out) const;
+
+    static const char* level_title(int level);
+
+private:
+    static const char* scan_spec(const char* p, int* stars, int* type, bool* long_long);
+
+private:
+    const char* format_;//调用点的格式串字面量，生命周期为整个进程
+    int arg_count_;
+    unsigned char arg_types_[MAX_ARGS];
+};
+
+#endif // !__LOGFORMAT_H_
@@ -0,0 +1,140 @@
+/**
+
+ * @Date    :       2020-12-26
+*/
+
+#ifndef __RINGQUEUE_H_
+#define __RINGQUEUE_H_
+
+#include <atomic>
+#include <memory>
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 有界无锁多生产者单消费者环形队列
+ * 每个槽位带序号，生产者通过CAS抢占槽位后原地填充数据，
+ * 消费者按序批量取出，全程不加锁也不拷贝元素
+*/
+template<class T>
+class RingQueue {
+public:
+    explicit RingQueue(size_t min_capacity = 1024);
+    ~RingQueue() = default;
+
+    template<class F> bool try_push(F&& fill);
+    template<class F> size_t pop_batch(F&& consume, size_t max_batch);
+
+    bool empty() const;
+    size_t size() const;
+    size_t capacity() const;
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;//槽位序号，用于判断槽位可写或可读
+        T data;
+    };
+
+    size_t mask_;//容量为2的幂，下标取模用掩码
+    std::unique_ptr<Cell[]> cells_;//环形缓冲区，初始化后不再分配
+
+    //生产者和消费者的位置分开放在不同缓存行，避免伪共享
+    char pad0_[64];
+    std::atomic<size_t> enqueue_pos_;//生产者抢占位置
+    char pad1_[64];
+    std::atomic<size_t> dequeue_pos_;//消费者读取位置，仅消费者修改
+};
+
+/**
+ * 容量向上取整到2的幂并初始化每个槽位的序号
+*/
+template<class T>
+RingQueue<T>::RingQueue(size_t min_capacity) : enqueue_pos_(0), dequeue_pos_(0) {
+    assert(min_capacity > 0);
+    size_t capacity = 2;
+    while (capacity < min_capacity) capacity <<= 1;
+    mask_ = capacity - 1;
+    cells_.reset(new Cell[capacity]);
+    for (size_t i = 0; i < capacity; i++) {
+        cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * 抢占一个空槽位并调用fill(T&)原地填充
+ * 队列满返回false，fill不会被调用
+*/
+template<class T>
+template<class F>
+bool RingQueue<T>::try_push(F&& fill) {
+    Cell* cell;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+        cell = &cells_[pos & mask_];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (dif == 0) {
+            if (enqueue_pos_.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) break;
+        }
+        else if (dif < 0) {//消费者还没取走这一圈的数据，队列已满
+            return false;
+        }
+        else {//被其他生产者抢先，重新读取位置
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+    fill(cell->data);
+    cell->seq.store(pos+1, std::memory_order_release);//发布给消费者
+    return true;
+}
+
+/**
+ * 按顺序取出最多max_batch个已发布的元素交给consume(T&)处理
+ * 只能由唯一的消费者线程调用，返回处理的个数
+*/
+template<class T>
+template<class F>
+size_t RingQueue<T>::pop_batch(F&& consume, size_t max_batch) {
+    size_t n = 0;
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (n < max_batch) {
+        Cell* cell = &cells_[pos & mask_];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos+1) < 0) break;//还未发布
+        consume(cell->data);
+        cell->seq.store(pos+mask_+1, std::memory_order_release);//归还给下一圈的生产者
+        pos++;
+        n++;
+    }
+    dequeue_pos_.store(pos, std::memory_order_relaxed);
+    return n;
+}
+
+/**
+ * 获取队列是否空（近似值）
+*/
+template<class T>
+bool RingQueue<T>::empty() const {
+    return size() == 0;
+}
+
+/**
+ * 获取当前队列元素个数（近似值，含已抢占未发布的槽位）
+*/
+template<class T>
+size_t RingQueue<T>::size() const {
+    size_t head = dequeue_pos_.load(std::memory_order_relaxed);
+    size_t tail = enqueue_pos_.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
+
+/**
+ * 获取队列的容量
+*/
+template<class T>
+size_t RingQueue<T>::capacity() const {
+    return mask_ + 1;
+}
+
+#endif // !__RINGQUEUE_H_
@@ -2,11 +2,25 @@
  * @Date    :       2020-12-18
 */
 
+#include <stdio.h>
+#include "config/config.h"
 #include "server/webserver.h"
 
 int main(int argc, char** argv) {
+    //读取配置：默认值、配置文件、环境变量、命令行
+    Config config;
+    if (!config.load(argc, argv)) {
+        if (config.is_help()) {
+            Config::usage(argv[0]);
+            return 0;
+        }
+        fprintf(stderr, "%s\n", config.get_error().c_str());
+        Config::usage(argv[0]);
+        return 1;
+    }
+
     //实例化一个web服务
-    WebServer server(3880, 3, 60000, false, 4, true, 0, 1024);
+    WebServer server(config);
     server.start();
     return 0;
-}
\ No newline at end of file
+}
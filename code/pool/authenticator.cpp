@@ -0,0 +1,113 @@
+/**
+
+ * @Date    :       2020-12-31
+*/
+
+#include "authenticator.h"
+#include "../log/log.h"
+
+Authenticator::Authenticator(UserStore* store, ThreadPool* store_pool, PasswordHasher* hasher) :
+        store_(store), store_pool_(store_pool), hasher_(hasher) {
+    assert(hasher_);
+}
+
+/**
+ * 校验登录或注册，结果通过done返回，done只会被调用一次
+*/
+void Authenticator::verify(const std::string& name, const std::string& password,
+                            bool is_login, const Callback& done) {
+    if (name == "" || password == "" || !store_) {
+        done(AUTH_FAIL);
+        return;
+    }
+    LOG_INFO("Verify name:%s", name.c_str());
+
+    if (is_login) login(name, password, done);
+    else signup(name, password, done);
+}
+
+/**
+ * 登录：先查用户缓存，重复登录和已知不存在的用户不访问存储
+ * 缓存和存储中保存的都是哈希，比对在哈希线程中进行
+*/
+void Authenticator::login(const std::string& name, const std::string& password, const Callback& done) {
+    std::string hashed;
+    UserCache::LOOKUP cached = UserCache::instance()->get(name, hashed);
+    if (cached == UserCache::CACHE_FOUND) {
+        check_password(password, hashed, done);
+        return;
+    }
+    if (cached == UserCache::CACHE_NOT_EXIST) {
+        done(AUTH_FAIL);
+        return;
+    }
+
+    run_store([this, name, password, done] {
+        std::string hashed;
+        UserStore::RESULT ret = store_->find_user(name, hashed);
+        if (ret == UserStore::STORE_NOT_FOUND) UserCache::instance()->put_not_exist(name);
+        if (ret != UserStore::STORE_OK) {
+            done(AUTH_FAIL);
+            return;
+        }
+        UserCache::instance()->put(name, hashed);
+        check_password(password, hashed, done);
+    });
+}
+
+/**
+ * 注册：已知存在的用户直接失败，否则先计算哈希再写入存储
+ * 注册以存储为准，缓存中不存在的用户仍需访问存储
+*/
+void Authenticator::signup(const std::string& name, const std::string& password, const Callback& done) {
+    std::string hashed;
+    if (UserCache::instance()->get(name, hashed) == UserCache::CACHE_FOUND) {
+        LOG_DEBUG("user used!");
+        done(AUTH_FAIL);
+        return;
+    }
+
+    bool submitted = hasher_->submit([this, name, password, done] {
+        std::string hashed = hasher_->hash(password);
+        if (hashed.empty()) {
+            LOG_ERROR("hash password error!");
+            done(AUTH_FAIL);
+            return;
+        }
+        run_store([this, name, hashed, done] {
+            UserStore::RESULT ret = store_->add_user(name, hashed);
+            if (ret == UserStore::STORE_EXIST) {
+                LOG_DEBUG("user used!");
+            }
+            else if (ret != UserStore::STORE_OK) {
+                LOG_DEBUG("Insert error!");
+            }
+            else {
+                //新用户写入后删除缓存的"不存在"条目
+                UserCache::instance()->invalidate(name);
+            }
+            done(ret == UserStore::STORE_OK ? AUTH_OK : AUTH_FAIL);
+        });
+    });
+    if (!submitted) done(AUTH_BUSY);
+}
+
+/**
+ * 在哈希线程中比对密码
+*/
+void Authenticator::check_password(const std::string& password, const std::string& hashed, const Callback& done) {
+    bool submitted = hasher_->submit([password, hashed, done] {
+        bool ok = PasswordHasher::verify(password, hashed);
+        if (!ok) LOG_DEBUG("pwd error!");
+        done(ok ? AUTH_OK : AUTH_FAIL);
+    });
+    if (!submitted) done(AUTH_BUSY);
+}
+
+/**
+ * 存储操作交给存储线程，没有存储线程时直接执行
+*/
+void Authenticator::run_store(const std::function<void()>& task) {
+    if (store_pool_) store_pool_->add_task(task);
+    else task();
+}
@@ -0,0 +1,49 @@
+/**
+
+ * @Date    :       2020-12-31
+*/
+
+#ifndef __AUTHENTICATOR_H_
+#define __AUTHENTICATOR_H_
+
+#include <functional>
+#include <string>
+#include <assert.h>
+#include "userstore.h"
+#include "usercache.h"
+#include "threadpool.h"
+#include "passwordhasher.h"
+
+/**
+ * 登录注册校验
+ * 查询用户缓存和用户存储，密码以bcrypt哈希保存，哈希计算交给PasswordHasher
+ * 校验是异步的，完成时在存储线程或哈希线程中回调结果
+*/
+class Authenticator {
+public:
+    enum RESULT {
+        AUTH_OK,
+        AUTH_FAIL,//用户名或密码错误、用户已存在、存储出错
+        AUTH_BUSY,//哈希队列已满，稍后重试
+    };
+    typedef std::function<void(RESULT)> Callback;
+
+    //store_pool为空时存储操作在调用线程中直接进行，适用于本地存储
+    Authenticator(UserStore* store, ThreadPool* store_pool, PasswordHasher* hasher);
+    ~Authenticator() = default;
+
+    void verify(const std::string& name, const std::string& password, bool is_login, const Callback& done);
+
+private:
+    void login(const std::string& name, const std::string& password, const Callback& done);
+    void signup(const std::string& name, const std::string& password, const Callback& done);
+    void check_password(const std::string& password, const std::string& hashed, const Callback& done);
+    void run_store(const std::function<void()>& task);
+
+private:
+    UserStore* store_;
+    ThreadPool* store_pool_;
+    PasswordHasher* hasher_;
+};
+
+#endif // !__AUTHENTICATOR_H_
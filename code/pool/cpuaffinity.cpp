@@ -0,0 +1,100 @@
+/**
+
+ * @Date    :       2021-01-06
+*/
+
+#include "cpuaffinity.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#ifdef USE_NUMA
+#include <numa.h>
+#endif
+
+/**
+ * 解析CPU列表，逗号分隔，每项是单个编号或闭区间
+*/
+bool CpuAffinity::parse(const std::string& list, std::vector<int>& cpus) {
+    cpus.clear();
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos) end = list.size();
+        std::string item = list.substr(pos, end - pos);
+        pos = end + 1;
+        if (item.empty()) continue;
+
+        char* p = nullptr;
+        long first = strtol(item.c_str(), &p, 10);
+        long last = first;
+        if (p == item.c_str()) return false;
+        if (*p == '-') {
+            const char* begin = p + 1;
+            last = strtol(begin, &p, 10);
+            if (p == begin) return false;
+        }
+        if (*p != '\0' || first < 0 || last < first || last >= CPU_SETSIZE) return false;
+        for (long cpu = first; cpu <= last; cpu++) cpus.push_back(static_cast<int>(cpu));
+    }
+    return !cpus.empty();
+}
+
+std::string CpuAffinity::to_string(const std::vector<int>& cpus) {
+    std::string str;
+    for (size_t i = 0; i < cpus.size(); i++) {
+        if (i) str += ',';
+        str += std::to_string(cpus[i]);
+    }
+    return str;
+}
+
+bool CpuAffinity::pin(const std::vector<int>& cpus) {
+    if (cpus.empty()) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+bool CpuAffinity::pin(int cpu) {
+    return pin(std::vector<int>(1, cpu));
+}
+
+bool CpuAffinity::is_numa_available() {
+#ifdef USE_NUMA
+    return numa_available() >= 0;
+#else
+    return false;
+#endif
+}
+
+int CpuAffinity::node_of(int cpu) {
+#ifdef USE_NUMA
+    if (is_numa_available()) return numa_node_of_cpu(cpu);
+#endif
+    (void)cpu;
+    return -1;
+}
+
+bool CpuAffinity::node_cpus(int node, std::vector<int>& cpus) {
+    cpus.clear();
+#ifdef USE_NUMA
+    if (!is_numa_available() || node < 0) return false;
+    struct bitmask* mask = numa_allocate_cpumask();
+    if (numa_node_to_cpus(node, mask) == 0) {
+        for (unsigned int i = 0; i < mask->size; i++) {
+            if (numa_bitmask_isbitset(mask, i)) cpus.push_back(static_cast<int>(i));
+        }
+    }
+    numa_free_cpumask(mask);
+#else
+    (void)node;
+#endif
+    return !cpus.empty();
+}
+
+void CpuAffinity::prefer_local_memory() {
+#ifdef USE_NUMA
+    if (is_numa_available()) numa_set_localalloc();
+#endif
+}
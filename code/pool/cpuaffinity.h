@@ -0,0 +1,32 @@
+/**
+
+ * @Date    :       2021-01-06
+*/
+
+#ifndef __CPUAFFINITY_H_
+#define __CPUAFFINITY_H_
+
+#include <string>
+#include <vector>
+
+/**
+ * 线程绑核与NUMA拓扑
+ * CPU列表的格式和taskset -c相同，如"0-3,8,10-11"
+ * NUMA相关功能需要libnuma，编译时定义USE_NUMA开启，否则只能绑核，拓扑查询返回失败
+*/
+class CpuAffinity {
+public:
+    static bool parse(const std::string& list, std::vector<int>& cpus);
+    static std::string to_string(const std::vector<int>& cpus);
+
+    //绑定当前线程
+    static bool pin(const std::vector<int>& cpus);
+    static bool pin(int cpu);
+
+    static bool is_numa_available();
+    static int node_of(int cpu);//未知时返回-1
+    static bool node_cpus(int node, std::vector<int>& cpus);
+    static void prefer_local_memory();//当前线程之后分配的内存优先放在所在节点
+};
+
+#endif // !__CPUAFFINITY_H_
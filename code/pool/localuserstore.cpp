@@ -0,0 +1,212 @@
+/**
+
+ * @Date    :       2020-12-30
+*/
+
+#include "localuserstore.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../log/log.h"
+
+const char LocalUserStore::MAGIC[8] = { 'T', 'U', 'S', 'E', 'R', 'D', 'B', '1' };
+
+LocalUserStore::LocalUserStore() : fd_(-1), map_(nullptr), capacity_(0), end_(0) {
+
+}
+
+LocalUserStore::~LocalUserStore() {
+    close();
+}
+
+/**
+ * 打开或创建数据文件并建立索引
+*/
+bool LocalUserStore::open(const char* path) {
+    assert(path);
+    std::lock_guard<std::mutex> lock(mtx_);
+    assert(fd_ < 0);
+    fd_ = ::open(path, O_RDWR|O_CREAT|O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        LOG_ERROR("open user store %s error!", path);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd_, &st) < 0) {
+        LOG_ERROR("stat user store %s error!", path);
+        release();
+        return false;
+    }
+    capacity_ = static_cast<size_t>(st.st_size);
+    if (capacity_ < INIT_CAPACITY) {
+        if (ftruncate(fd_, INIT_CAPACITY) < 0) {
+            LOG_ERROR("extend user store %s error!", path);
+            release();
+            return false;
+        }
+        capacity_ = INIT_CAPACITY;
+    }
+
+    void* ret = mmap(nullptr, capacity_, PROT_READ|PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (ret == MAP_FAILED) {
+        LOG_ERROR("mmap user store %s error!", path);
+        release();
+        return false;
+    }
+    map_ = static_cast<char*>(ret);
+
+    if (!load()) {
+        LOG_ERROR("user store %s is not a user store file!", path);
+        release();
+        return false;
+    }
+    LOG_INFO("user store %s opened, users: %d", path, static_cast<int>(index_.size()));
+    return true;
+}
+
+/**
+ * 扫描记录建立索引，遇到空记录或校验失败的记录即为数据末尾
+*/
+bool LocalUserStore::load() {
+    index_.clear();
+    bool empty = true;
+    for (size_t i = 0; i < sizeof(MAGIC); i++) {
+        if (map_[i]) empty = false;
+    }
+    if (empty) {//新文件
+        memcpy(map_, MAGIC, sizeof(MAGIC));
+    }
+    else if (memcmp(map_, MAGIC, sizeof(MAGIC)) != 0) {
+        return false;
+    }
+
+    size_t off = sizeof(MAGIC);
+    while (off + HEAD_LEN <= capacity_) {
+        uint32_t sum;
+        uint16_t name_len, pwd_len;
+        memcpy(&sum, map_+off, 4);
+        memcpy(&name_len, map_+off+4, 2);
+        memcpy(&pwd_len, map_+off+6, 2);
+        size_t len = HEAD_LEN + name_len + pwd_len;
+        if (name_len == 0 || off + len > capacity_
+                || sum != checksum(map_+off+4, len-4)) break;
+        //同名记录以后写入的为准
+        index_[std::string(map_+off+HEAD_LEN, name_len)] = off;
+        off += len;
+    }
+    end_ = off;
+    return true;
+}
+
+/**
+ * 保证末尾还有len字节空间，不够时按倍数扩大文件并重新映射
+*/
+bool LocalUserStore::reserve(size_t len) {
+    if (end_ + len <= capacity_) return true;
+    size_t capacity = capacity_;
+    while (end_ + len > capacity) capacity *= 2;
+    if (ftruncate(fd_, capacity) < 0) return false;
+    void* ret = mremap(map_, capacity_, capacity, MREMAP_MAYMOVE);
+    if (ret == MAP_FAILED) return false;
+    map_ = static_cast<char*>(ret);
+    capacity_ = capacity;
+    return true;
+}
+
+/**
+ * 按用户名查索引，从映射中取出密码
+*/
+UserStore::RESULT LocalUserStore::find_user(const std::string& name, std::string& password) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!map_) return STORE_ERROR;
+    auto it = index_.find(name);
+    if (it == index_.end()) return STORE_NOT_FOUND;
+
+    uint16_t name_len, pwd_len;
+    memcpy(&name_len, map_+it->second+4, 2);
+    memcpy(&pwd_len, map_+it->second+6, 2);
+    password.assign(map_+it->second+HEAD_LEN+name_len, pwd_len);
+    return STORE_OK;
+}
+
+/**
+ * 追加一条用户记录
+*/
+UserStore::RESULT LocalUserStore::add_user(const std::string& name, const std::string& password) {
+    if (name.empty() || name.size() > MAX_FIELD_LEN || password.size() > MAX_FIELD_LEN) {
+        return STORE_ERROR;
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!map_) return STORE_ERROR;
+    if (index_.count(name)) return STORE_EXIST;
+
+    size_t len = HEAD_LEN + name.size() + password.size();
+    if (!reserve(len)) {
+        LOG_ERROR("user store grow error!");
+        return STORE_ERROR;
+    }
+
+    char* p = map_ + end_;
+    uint16_t name_len = static_cast<uint16_t>(name.size());
+    uint16_t pwd_len = static_cast<uint16_t>(password.size());
+    memcpy(p+HEAD_LEN, name.data(), name_len);
+    memcpy(p+HEAD_LEN+name_len, password.data(), pwd_len);
+    memcpy(p+4, &name_len, 2);
+    memcpy(p+6, &pwd_len, 2);
+    uint32_t sum = checksum(p+4, len-4);
+    memcpy(p, &sum, 4);//最后写校验和，记录才算完整
+
+    index_[name] = end_;
+    end_ += len;
+    return STORE_OK;
+}
+
+/**
+ * 获取用户数
+*/
+size_t LocalUserStore::size() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return index_.size();
+}
+
+/**
+ * 把映射写回文件后关闭
+*/
+void LocalUserStore::close() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    release();
+}
+
+/**
+ * 解除映射并关闭文件，调用者持有锁，打开失败时也用它复位
+*/
+void LocalUserStore::release() {
+    if (map_) {
+        msync(map_, capacity_, MS_SYNC);
+        munmap(map_, capacity_);
+        map_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    capacity_ = 0;
+    end_ = 0;
+    index_.clear();
+}
+
+/**
+ * FNV-1a校验和，校验和为0时改为1，避免与空记录混淆
+*/
+uint32_t LocalUserStore::checksum(const char* data, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash ? hash : 1;
+}
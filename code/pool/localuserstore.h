@@ -0,0 +1,59 @@
+/**
+
+ * @Date    :       2020-12-30
+*/
+
+#ifndef __LOCALUSERSTORE_H_
+#define __LOCALUSERSTORE_H_
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <stddef.h>
+#include <stdint.h>
+#include "userstore.h"
+
+/**
+ * 嵌入式本地用户存储，不依赖外部服务
+ * 数据文件通过mmap映射，新用户只追加写在文件末尾，
+ * 打开时扫描一遍建立用户名到记录偏移的哈希索引
+ *
+ * 文件格式：8字节魔数，之后依次为记录
+ *   u32 校验和, u16 用户名长度, u16 密码长度, 用户名, 密码
+ * 先写内容后写记录头，崩溃时残缺的记录校验失败，打开时从该处截断
+*/
+class LocalUserStore : public UserStore {
+public:
+    LocalUserStore();
+    ~LocalUserStore();
+
+    bool open(const char* path);
+    void close();
+
+    RESULT find_user(const std::string& name, std::string& password) override;
+    RESULT add_user(const std::string& name, const std::string& password) override;
+
+    size_t size();
+
+private:
+    bool load();
+    void release();
+    bool reserve(size_t len);
+    static uint32_t checksum(const char* data, size_t len);
+
+private:
+    static const char MAGIC[8];
+    static const size_t HEAD_LEN = 8;//记录头长度
+    static const size_t MAX_FIELD_LEN = 1024;//用户名和密码的最大长度
+    static const size_t INIT_CAPACITY = 1 << 20;
+
+    int fd_;
+    char* map_;//文件映射地址，扩容时可能移动
+    size_t capacity_;//映射长度，即文件长度
+    size_t end_;//有效数据末尾，新记录从这里追加
+
+    std::unordered_map<std::string, size_t> index_;//用户名->记录偏移
+    std::mutex mtx_;
+};
+
+#endif // !__LOCALUSERSTORE_H_
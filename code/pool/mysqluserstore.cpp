@@ -0,0 +1,319 @@
+/**
+
+ * @Date    :       2020-12-30
+*/
+
+#include "mysqluserstore.h"
+#include <mysql/mysqld_error.h>
+#include <algorithm>
+#include <chrono>
+#include <unordered_set>
+#include <string.h>
+#include <assert.h>
+
+/**
+ * 登录和注册的预处理语句，参数通过二进制协议传输，不拼接SQL
+ * 注册用一条带NOT EXISTS的INSERT完成检查和插入，影响行数为0说明用户名已被使用
+*/
+static const char* SELECT_USER_SQL = "SELECT password FROM user WHERE username=? LIMIT 1";
+static const char* INSERT_USER_SQL = "INSERT INTO user(username, password) SELECT ?, ? FROM DUAL "
+                                     "WHERE NOT EXISTS (SELECT 1 FROM user WHERE username=?)";
+
+MysqlUserStore::MysqlUserStore(SqlConPool* conpool, int batch_window_ms) : conpool_(conpool),
+        batch_window_ms_(batch_window_ms), is_close_(false) {
+    assert(conpool_);
+    if (batch_window_ms_ > 0) writer_.reset(new std::thread(writer_thread, this));
+}
+
+MysqlUserStore::~MysqlUserStore() {
+    if (writer_ && writer_->joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            is_close_ = true;
+        }
+        cond_writer_.notify_all();
+        writer_->join();
+    }
+}
+
+void MysqlUserStore::bind_string(MYSQL_BIND& bind, const std::string& value, unsigned long& length) {
+    length = value.size();
+    bind.buffer_type = MYSQL_TYPE_STRING;
+    bind.buffer = const_cast<char*>(value.data());
+    bind.buffer_length = length;
+    bind.length = &length;
+}
+
+/**
+ * 执行出错时连接可能已断开，丢弃预处理语句以便下次重新prepare
+*/
+void MysqlUserStore::stmt_error(SqlConRAII& sql_conn, MYSQL_STMT* stmt, const char* query) {
+    LOG_ERROR("Mysql stmt error: %s", mysql_stmt_error(stmt));
+    sql_conn.discard(query);
+}
+
+/**
+ * 查询用户密码
+*/
+UserStore::RESULT MysqlUserStore::find_user(const std::string& name, std::string& password) {
+    MYSQL* sql;
+    SqlConRAII sql_conn(&sql, conpool_);
+    if (!sql) return STORE_ERROR;
+
+    MYSQL_STMT* stmt = sql_conn.prepare(SELECT_USER_SQL);
+    if (!stmt) return STORE_ERROR;
+
+    MYSQL_BIND param[1];
+    unsigned long name_len;
+    memset(param, 0, sizeof(param));
+    bind_string(param[0], name, name_len);
+
+    char buff[256];
+    unsigned long pwd_len = 0;
+    MYSQL_BIND result[1];
+    memset(result, 0, sizeof(result));
+    result[0].buffer_type = MYSQL_TYPE_STRING;
+    result[0].buffer = buff;
+    result[0].buffer_length = sizeof(buff);
+    result[0].length = &pwd_len;
+
+    if (mysql_stmt_bind_param(stmt, param) || mysql_stmt_execute(stmt)
+            || mysql_stmt_bind_result(stmt, result) || mysql_stmt_store_result(stmt)) {
+        stmt_error(sql_conn, stmt, SELECT_USER_SQL);
+        return STORE_ERROR;
+    }
+
+    int ret = mysql_stmt_fetch(stmt);
+    RESULT found = STORE_NOT_FOUND;
+    if (ret == 0 || ret == MYSQL_DATA_TRUNCATED) {
+        password.assign(buff, std::min(static_cast<size_t>(pwd_len), sizeof(buff)));
+        found = STORE_OK;
+    }
+    else if (ret != MYSQL_NO_DATA) {
+        found = STORE_ERROR;
+    }
+    mysql_stmt_free_result(stmt);
+    if (found == STORE_ERROR) stmt_error(sql_conn, stmt, SELECT_USER_SQL);
+    return found;
+}
+
+/**
+ * 注册新用户
+ * 开启分组提交时排队等待写线程提交，否则单独执行一条INSERT
+*/
+UserStore::RESULT MysqlUserStore::add_user(const std::string& name, const std::string& password) {
+    if (!writer_) {
+        MYSQL* sql;
+        SqlConRAII sql_conn(&sql, conpool_);
+        if (!sql) return STORE_ERROR;
+        return add_one(sql_conn, name, password);
+    }
+
+    PendingUser user = { &name, &password, STORE_ERROR, false };
+    std::unique_lock<std::mutex> lock(mtx_);
+    if (is_close_) return STORE_ERROR;
+    pending_.push_back(&user);
+    cond_writer_.notify_one();
+    cond_done_.wait(lock, [&user] { return user.done; });
+    return user.result;
+}
+
+/**
+ * 插入一个新用户，一次往返完成检查和插入
+*/
+UserStore::RESULT MysqlUserStore::add_one(SqlConRAII& sql_conn, const std::string& name,
+                                          const std::string& password) {
+    MYSQL_STMT* stmt = sql_conn.prepare(INSERT_USER_SQL);
+    if (!stmt) return STORE_ERROR;
+
+    MYSQL_BIND param[3];
+    unsigned long len[3];
+    memset(param, 0, sizeof(param));
+    bind_string(param[0], name, len[0]);
+    bind_string(param[1], password, len[1]);
+    bind_string(param[2], name, len[2]);
+
+    if (mysql_stmt_bind_param(stmt, param) || mysql_stmt_execute(stmt)) {
+        if (mysql_stmt_errno(stmt) == ER_DUP_ENTRY) return STORE_EXIST;//用户名有唯一索引时并发注册会走到这里
+        stmt_error(sql_conn, stmt, INSERT_USER_SQL);
+        return STORE_ERROR;
+    }
+    return mysql_stmt_affected_rows(stmt) == 1 ? STORE_OK : STORE_EXIST;
+}
+
+/**
+ * 分组提交写线程任务函数
+*/
+void MysqlUserStore::writer_thread(MysqlUserStore* store) {
+    store->write_loop();
+}
+
+/**
+ * 第一个注册到达后再等batch_window_ms，或攒满MAX_BATCH个，一起提交
+ * 提交完成后唤醒等待的请求线程
+*/
+void MysqlUserStore::write_loop() {
+    std::vector<PendingUser*> batch;
+    std::unique_lock<std::mutex> lock(mtx_);
+    while (true) {
+        cond_writer_.wait(lock, [this] { return is_close_ || !pending_.empty(); });
+        if (pending_.empty()) break;//关闭且没有剩余请求
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(batch_window_ms_);
+        cond_writer_.wait_until(lock, deadline, [this] {
+            return is_close_ || pending_.size() >= MAX_BATCH;
+        });
+
+        size_t n = std::min(pending_.size(), MAX_BATCH);
+        batch.assign(pending_.begin(), pending_.begin() + n);
+        pending_.erase(pending_.begin(), pending_.begin() + n);
+
+        lock.unlock();
+        commit_batch(batch);
+        lock.lock();
+
+        for (PendingUser* user : batch) user->done = true;
+        cond_done_.notify_all();
+    }
+}
+
+/**
+ * 提交一组注册
+ * 同一组内重名的只有第一个有效；先在事务中锁定查询已存在的用户名，
+ * 再用一条多行INSERT写入其余用户。插入仍因唯一索引冲突失败时(其他进程并发注册)，
+ * 回滚后逐个插入，保证每个请求得到正确的结果
+*/
+void MysqlUserStore::commit_batch(std::vector<PendingUser*>& batch) {
+    std::vector<PendingUser*> users;
+    std::unordered_set<std::string> names;
+    for (PendingUser* user : batch) {
+        user->result = STORE_ERROR;
+        if (names.insert(*user->name).second) users.push_back(user);
+        else user->result = STORE_EXIST;
+    }
+
+    MYSQL* sql;
+    SqlConRAII sql_conn(&sql, conpool_);
+    if (!sql) return;
+
+    if (users.size() == 1) {
+        users[0]->result = add_one(sql_conn, *users[0]->name, *users[0]->password);
+        return;
+    }
+
+    mysql_autocommit(sql, false);
+    bool ok = select_exist(sql_conn, users) && insert_batch(sql_conn, users);
+    if (ok && !mysql_commit(sql)) {
+        for (PendingUser* user : users) {
+            if (user->result != STORE_EXIST) user->result = STORE_OK;
+        }
+    }
+    else {
+        mysql_rollback(sql);
+        ok = false;
+    }
+    mysql_autocommit(sql, true);
+
+    if (!ok) {
+        LOG_WARN("batch register of %d users failed, retry one by one", static_cast<int>(users.size()));
+        for (PendingUser* user : users) {
+            user->result = add_one(sql_conn, *user->name, *user->password);
+        }
+    }
+    LOG_DEBUG("batch register %d users", static_cast<int>(batch.size()));
+}
+
+/**
+ * 锁定查询组内已存在的用户名，标记为STORE_EXIST
+ * 参数个数补齐到2的幂，重复的用户名不影响结果，每个连接最多缓存log2(MAX_BATCH)+1条语句
+*/
+bool MysqlUserStore::select_exist(SqlConRAII& sql_conn, std::vector<PendingUser*>& users) {
+    assert(!users.empty() && users.size() <= MAX_BATCH);
+    size_t shape = 1;
+    while (shape < users.size()) shape <<= 1;
+
+    std::string query = "SELECT username FROM user WHERE username IN (?";
+    for (size_t i = 1; i < shape; i++) query += ",?";
+    query += ") FOR UPDATE";
+
+    MYSQL_STMT* stmt = sql_conn.prepare(query.c_str());
+    if (!stmt) return false;
+
+    std::vector<MYSQL_BIND> param(shape);
+    std::vector<unsigned long> len(shape);
+    memset(param.data(), 0, sizeof(MYSQL_BIND) * param.size());
+    for (size_t i = 0; i < shape; i++) {
+        bind_string(param[i], *users[std::min(i, users.size() - 1)]->name, len[i]);
+    }
+
+    char buff[256];
+    unsigned long name_len = 0;
+    MYSQL_BIND result[1];
+    memset(result, 0, sizeof(result));
+    result[0].buffer_type = MYSQL_TYPE_STRING;
+    result[0].buffer = buff;
+    result[0].buffer_length = sizeof(buff);
+    result[0].length = &name_len;
+
+    if (mysql_stmt_bind_param(stmt, param.data()) || mysql_stmt_execute(stmt)
+            || mysql_stmt_bind_result(stmt, result) || mysql_stmt_store_result(stmt)) {
+        stmt_error(sql_conn, stmt, query.c_str());
+        return false;
+    }
+
+    int ret;
+    while ((ret = mysql_stmt_fetch(stmt)) == 0 || ret == MYSQL_DATA_TRUNCATED) {
+        std::string name(buff, std::min(static_cast<size_t>(name_len), sizeof(buff)));
+        for (PendingUser* user : users) {
+            if (*user->name == name) user->result = STORE_EXIST;
+        }
+    }
+    mysql_stmt_free_result(stmt);
+    if (ret != MYSQL_NO_DATA) {
+        stmt_error(sql_conn, stmt, query.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * 多行INSERT写入组内尚不存在的用户
+ * 按2的幂拆成几条语句(如13 = 8+4+1)，语句形状固定，预处理语句缓存不会随组大小增长
+*/
+bool MysqlUserStore::insert_batch(SqlConRAII& sql_conn, std::vector<PendingUser*>& users) {
+    std::vector<PendingUser*> fresh;
+    for (PendingUser* user : users) {
+        if (user->result != STORE_EXIST) fresh.push_back(user);
+    }
+
+    size_t begin = 0;
+    while (begin < fresh.size()) {
+        size_t n = 1;
+        while (n * 2 <= fresh.size() - begin) n <<= 1;
+        if (!insert_rows(sql_conn, fresh.data() + begin, n)) return false;
+        begin += n;
+    }
+    return true;
+}
+
+bool MysqlUserStore::insert_rows(SqlConRAII& sql_conn, PendingUser* const* users, size_t n) {
+    std::string query = "INSERT INTO user(username, password) VALUES (?,?)";
+    for (size_t i = 1; i < n; i++) query += ",(?,?)";
+
+    MYSQL_STMT* stmt = sql_conn.prepare(query.c_str());
+    if (!stmt) return false;
+
+    std::vector<MYSQL_BIND> param(n * 2);
+    std::vector<unsigned long> len(n * 2);
+    memset(param.data(), 0, sizeof(MYSQL_BIND) * param.size());
+    for (size_t i = 0; i < n; i++) {
+        bind_string(param[2*i], *users[i]->name, len[2*i]);
+        bind_string(param[2*i+1], *users[i]->password, len[2*i+1]);
+    }
+
+    if (mysql_stmt_bind_param(stmt, param.data()) || mysql_stmt_execute(stmt)) {
+        if (mysql_stmt_errno(stmt) != ER_DUP_ENTRY) stmt_error(sql_conn, stmt, query.c_str());
+        return false;
+    }
+    return true;
+}
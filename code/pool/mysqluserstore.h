@@ -0,0 +1,66 @@
+/**
+
+ * @Date    :       2020-12-30
+*/
+
+#ifndef __MYSQLUSERSTORE_H_
+#define __MYSQLUSERSTORE_H_
+
+#include <mysql/mysql.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "userstore.h"
+#include "sqlconRAII.h"
+
+/**
+ * 基于MySQL的用户存储，通过连接池上缓存的预处理语句访问user表
+ * 注册请求交给写线程分组提交：在batch_window_ms内到达的注册合并成
+ * 一个事务里的多行INSERT，每个请求仍然得到各自的结果
+*/
+class MysqlUserStore : public UserStore {
+public:
+    explicit MysqlUserStore(SqlConPool* conpool, int batch_window_ms = 2);
+    ~MysqlUserStore();
+
+    RESULT find_user(const std::string& name, std::string& password) override;
+    RESULT add_user(const std::string& name, const std::string& password) override;
+
+private:
+    //一个等待分组提交的注册请求，由调用线程在栈上创建
+    struct PendingUser {
+        const std::string* name;
+        const std::string* password;
+        RESULT result;
+        bool done;
+    };
+
+    RESULT add_one(SqlConRAII& sql_conn, const std::string& name, const std::string& password);
+
+    static void writer_thread(MysqlUserStore* store);
+    void write_loop();
+    void commit_batch(std::vector<PendingUser*>& batch);
+    bool select_exist(SqlConRAII& sql_conn, std::vector<PendingUser*>& users);
+    bool insert_batch(SqlConRAII& sql_conn, std::vector<PendingUser*>& users);
+    bool insert_rows(SqlConRAII& sql_conn, PendingUser* const* users, size_t n);
+
+    static void bind_string(MYSQL_BIND& bind, const std::string& value, unsigned long& length);
+    static void stmt_error(SqlConRAII& sql_conn, MYSQL_STMT* stmt, const char* query);
+
+private:
+    static const size_t MAX_BATCH = 64;//一次提交的最大注册数
+
+    SqlConPool* conpool_;
+    int batch_window_ms_;//分组等待时间，0为不分组，每个注册单独提交
+
+    std::vector<PendingUser*> pending_;
+    std::mutex mtx_;
+    std::condition_variable cond_writer_;
+    std::condition_variable cond_done_;
+    bool is_close_;
+    std::unique_ptr<std::thread> writer_;
+};
+
+#endif // !__MYSQLUSERSTORE_H_
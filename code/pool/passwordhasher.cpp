@@ -0,0 +1,127 @@
+/**
+
+ * @Date    :       2020-12-31
+*/
+
+#include "passwordhasher.h"
+#include <algorithm>
+#include <chrono>
+#include <assert.h>
+#include <crypt.h>
+#include <string.h>
+
+namespace {
+
+/**
+ * crypt_r的工作区约32KB，每个线程分配一次
+*/
+struct crypt_data* thread_crypt_data() {
+    static thread_local std::unique_ptr<struct crypt_data> data(new struct crypt_data());
+    return data.get();
+}
+
+/**
+ * 比较耗时与内容无关，不泄露匹配的前缀长度
+*/
+bool constant_equal(const char* a, size_t a_len, const char* b, size_t b_len) {
+    unsigned char diff = (a_len != b_len);
+    size_t len = a_len < b_len ? a_len : b_len;
+    for (size_t i = 0; i < len; i++) {
+        diff |= static_cast<unsigned char>(a[i] ^ b[i]);
+    }
+    return diff == 0;
+}
+
+}
+
+/**
+ * thread_num：计算线程数，0为CPU核数的一半，留出核给处理连接的线程
+ * max_queue：排队和正在计算的任务上限
+*/
+PasswordHasher::PasswordHasher(int thread_num, int max_queue, int cost) :
+        max_queue_(max_queue), cost_(cost), depth_(0), tasks_(0), rejected_(0),
+        run_time_us_(0), wait_time_us_(0), max_latency_us_(0) {
+    if (thread_num <= 0) thread_num = std::max(1u, std::thread::hardware_concurrency() / 2);
+    assert(max_queue_ > 0);
+    pool_.reset(new ThreadPool(thread_num));
+}
+
+/**
+ * 提交一个哈希任务，队列满时返回false，任务不会执行
+*/
+bool PasswordHasher::submit(std::function<void()> task) {
+    if (depth_.fetch_add(1) >= max_queue_) {
+        depth_--;
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    typedef std::chrono::steady_clock SteadyClock;
+    SteadyClock::time_point submit_time = SteadyClock::now();
+    pool_->add_task([this, task, submit_time] {
+        using std::chrono::duration_cast;
+        using std::chrono::microseconds;
+        SteadyClock::time_point begin = SteadyClock::now();
+        task();
+        SteadyClock::time_point end = SteadyClock::now();
+        depth_--;
+
+        uint64_t wait_us = duration_cast<microseconds>(begin - submit_time).count();
+        uint64_t run_us = duration_cast<microseconds>(end - begin).count();
+        tasks_.fetch_add(1, std::memory_order_relaxed);
+        wait_time_us_.fetch_add(wait_us, std::memory_order_relaxed);
+        run_time_us_.fetch_add(run_us, std::memory_order_relaxed);
+        uint64_t latency = wait_us + run_us;
+        uint64_t max_latency = max_latency_us_.load(std::memory_order_relaxed);
+        while (latency > max_latency && !max_latency_us_.compare_exchange_weak(max_latency, latency)) {}
+    });
+    return true;
+}
+
+/**
+ * 生成带随机盐的bcrypt哈希，失败返回空串
+*/
+std::string PasswordHasher::hash(const std::string& password) const {
+    char setting[CRYPT_GENSALT_OUTPUT_SIZE];
+    if (!crypt_gensalt_rn("$2b$", cost_, nullptr, 0, setting, sizeof(setting))) return "";
+    const char* hashed = crypt_r(password.c_str(), setting, thread_crypt_data());
+    if (!hashed || hashed[0] == '*') return "";
+    return hashed;
+}
+
+/**
+ * 校验密码
+ * 不是以$开头的为旧的明文密码，直接比较，兼容已有用户
+*/
+bool PasswordHasher::verify(const std::string& password, const std::string& hashed) {
+    if (hashed.empty() || hashed[0] != '$') {
+        return constant_equal(password.data(), password.size(), hashed.data(), hashed.size());
+    }
+    const char* ret = crypt_r(password.c_str(), hashed.c_str(), thread_crypt_data());
+    if (!ret || ret[0] == '*') return false;
+    return constant_equal(ret, strlen(ret), hashed.data(), hashed.size());
+}
+
+int PasswordHasher::get_queue_depth() const {
+    return depth_;
+}
+
+uint64_t PasswordHasher::get_task_count() const {
+    return tasks_.load(std::memory_order_relaxed);
+}
+
+uint64_t PasswordHasher::get_rejected_count() const {
+    return rejected_.load(std::memory_order_relaxed);
+}
+
+uint64_t PasswordHasher::get_run_time_us() const {
+    return run_time_us_.load(std::memory_order_relaxed);
+}
+
+uint64_t PasswordHasher::get_wait_time_us() const {
+    return wait_time_us_.load(std::memory_order_relaxed);
+}
+
+uint64_t PasswordHasher::get_max_latency_us() const {
+    return max_latency_us_.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,55 @@
+/**
+
+ * @Date    :       2020-12-31
+*/
+
+#ifndef __PASSWORDHASHER_H_
+#define __PASSWORDHASHER_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <stdint.h>
+#include <assert.h>
+#include "threadpool.h"
+
+/**
+ * 密码哈希执行器
+ * bcrypt计算很耗CPU，放在独立的线程中进行，不占用处理连接的线程
+ * 排队(含正在计算)的任务数有上限，超过时提交失败，由调用者返回503
+*/
+class PasswordHasher {
+public:
+    PasswordHasher(int thread_num = 0, int max_queue = 256, int cost = 10);
+    ~PasswordHasher() = default;
+
+    bool submit(std::function<void()> task);
+    void shutdown() { pool_->shutdown(); }//等待已提交的任务完成
+
+    std::string hash(const std::string& password) const;
+    static bool verify(const std::string& password, const std::string& hashed);
+
+    //监控指标
+    int get_queue_depth() const;
+    uint64_t get_task_count() const;
+    uint64_t get_rejected_count() const;
+    uint64_t get_run_time_us() const;//任务累计计算时间
+    uint64_t get_wait_time_us() const;//任务累计排队时间
+    uint64_t get_max_latency_us() const;//单个任务从提交到完成的最大耗时
+
+private:
+    int max_queue_;
+    int cost_;//bcrypt的cost，每加1计算量翻倍
+
+    std::atomic<int> depth_;
+    std::atomic<uint64_t> tasks_;
+    std::atomic<uint64_t> rejected_;
+    std::atomic<uint64_t> run_time_us_;
+    std::atomic<uint64_t> wait_time_us_;
+    std::atomic<uint64_t> max_latency_us_;
+
+    std::unique_ptr<ThreadPool> pool_;
+};
+
+#endif // !__PASSWORDHASHER_H_
@@ -18,7 +18,16 @@ public:
     }
 
     ~SqlConRAII() { 
-        conpool_->free_connection(sql_);
+        if (sql_) conpool_->free_connection(sql_);//取连接超时时为nullptr
+    }
+
+    //获取本连接上缓存的预处理语句
+    MYSQL_STMT* prepare(const char* query) {
+        return sql_ ? conpool_->get_statement(sql_, query) : nullptr;
+    }
+
+    void discard(const char* query) {
+        conpool_->discard_statement(sql_, query);
     }
 
 private:
@@ -3,8 +3,21 @@
  * @Date    :       2020-12-18
 */
 #include "sqlconpool.h"
+#include <algorithm>
+#include <string.h>
 
-SqlConPool::SqlConPool() {
+namespace {
+
+int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+SqlConPool::SqlConPool() : port_(0), min_size_(0), max_size_(0), timeout_ms_(1000),
+        free_head_(0), free_count_(0), open_count_(0), busy_count_(0), peak_busy_(0),
+        waiters_(0), checkout_count_(0), timeout_count_(0), wait_time_us_(0), is_close_(false) {
 
 }
 
@@ -17,61 +30,355 @@ SqlConPool* SqlConPool::instance() {
     return &pool;
 }
 
+/**
+ * 初始化连接池
+ * 先建立min_size个连接，连接失败的槽位交给后台线程重连，不会放入空闲栈
+ * max_size：连接数上限，小于min_size时取min_size
+ * timeout_ms：取连接的默认等待时间，负数为一直等待
+*/
 void SqlConPool::init(const char* host, int port,
                  const char* user, const char* password,
-                 const char* db_name, int con_size) {
-    assert(host && port > 0 && user && password && db_name && con_size > 0);
-    for (int i = 0; i < con_size; i++) {
-        MYSQL *sql = nullptr;
-        sql = mysql_init(sql);
-        if (!sql) {
-            LOG_ERROR("Mysql init error");
-            assert(sql);
+                 const char* db_name, int min_size,
+                 int max_size, int timeout_ms) {
+    assert(host && port > 0 && user && password && db_name && min_size > 0);
+    assert(!conns_);
+    host_ = host;
+    port_ = port;
+    user_ = user;
+    password_ = password;
+    db_name_ = db_name;
+    min_size_ = min_size;
+    max_size_ = std::max(min_size, max_size);
+    timeout_ms_ = timeout_ms;
+
+    conns_.reset(new MYSQL[max_size_]);
+    states_.reset(new std::atomic<int>[max_size_]);
+    next_.reset(new std::atomic<uint32_t>[max_size_]);
+    last_used_.reset(new std::atomic<int64_t>[max_size_]);
+    stmts_.reset(new StmtCache[max_size_]);
+    for (int i = 0; i < max_size_; i++) {
+        states_[i] = SLOT_EMPTY;
+        next_[i] = 0;
+        last_used_[i] = 0;
+    }
+
+    for (int i = 0; i < min_size_; i++) {
+        open_count_++;
+        if (connect_slot(i)) push_free(i);
+        else states_[i] = SLOT_BROKEN;
+    }
+
+    is_close_ = false;
+    maintain_thread_.reset(new std::thread(maintain_thread, this));
+}
+
+/**
+ * 在槽位上建立连接，MYSQL结构体由连接池提供
+*/
+bool SqlConPool::connect_slot(int slot) {
+    MYSQL* sql = &conns_[slot];
+    if (!mysql_init(sql)) {
+        LOG_ERROR("Mysql init error");
+        return false;
+    }
+    unsigned int connect_timeout = 3;
+    mysql_options(sql, MYSQL_OPT_CONNECT_TIMEOUT, &connect_timeout);
+    if (!mysql_real_connect(sql, host_.c_str(), user_.c_str(), password_.c_str(),
+                            db_name_.c_str(), port_, nullptr, 0)) {
+        LOG_ERROR("Mysql real_connect error: %s", mysql_error(sql));
+        mysql_close(sql);
+        return false;
+    }
+    last_used_[slot] = now_ms();
+    return true;
+}
+
+/**
+ * 关闭槽位上的连接及其预处理语句
+*/
+void SqlConPool::close_slot(int slot) {
+    for (auto& item : stmts_[slot]) mysql_stmt_close(item.second);
+    stmts_[slot].clear();
+    mysql_close(&conns_[slot]);
+}
+
+int SqlConPool::get_slot(MYSQL* connection) const {
+    int slot = static_cast<int>(connection - conns_.get());
+    assert(slot >= 0 && slot < max_size_);
+    return slot;
+}
+
+/**
+ * 槽位压入空闲栈，有线程在等待时唤醒一个
+*/
+void SqlConPool::push_free(int slot) {
+    states_[slot] = SLOT_IDLE;
+    last_used_[slot] = now_ms();
+    uint64_t head = free_head_.load(std::memory_order_relaxed);
+    uint64_t new_head;
+    do {
+        next_[slot].store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+        new_head = (((head >> 32) + 1) << 32) | static_cast<uint32_t>(slot + 1);
+    } while (!free_head_.compare_exchange_weak(head, new_head,
+                std::memory_order_release, std::memory_order_relaxed));
+    free_count_++;
+
+    if (waiters_ > 0) {
+        std::lock_guard<std::mutex> lock(wait_mtx_);
+        cond_free_.notify_one();
+    }
+}
+
+/**
+ * 从空闲栈弹出一个槽位，栈空返回-1
+*/
+int SqlConPool::pop_free() {
+    uint64_t head = free_head_.load(std::memory_order_acquire);
+    while (true) {
+        uint32_t top = static_cast<uint32_t>(head);
+        if (top == 0) return -1;
+        uint64_t next = next_[top-1].load(std::memory_order_relaxed);
+        uint64_t new_head = (((head >> 32) + 1) << 32) | next;
+        if (free_head_.compare_exchange_weak(head, new_head,
+                std::memory_order_acquire, std::memory_order_acquire)) {
+            free_count_--;
+            return top - 1;
+        }
+    }
+}
+
+/**
+ * 连接数未达上限时占用一个空槽位新建连接
+*/
+int SqlConPool::try_grow() {
+    if (open_count_ >= max_size_) return -1;
+    for (int i = 0; i < max_size_; i++) {
+        int state = SLOT_EMPTY;
+        if (!states_[i].compare_exchange_strong(state, SLOT_CONNECTING)) continue;
+        open_count_++;
+        if (connect_slot(i)) {
+            states_[i] = SLOT_BUSY;
+            return i;
         }
+        states_[i] = SLOT_BROKEN;
+        return -1;
+    }
+    return -1;
+}
 
-        sql = mysql_real_connect(sql, host, user, password, 
-                                db_name, port, nullptr, 0);
-        if (!sql) {
-            LOG_ERROR("Mysql real_connect error");
-        }   
-        conn_queue_.push(sql);
+/**
+ * 不等待地取一个可用连接
+ * 空闲较久的连接先ping，失效的交给后台线程重连
+*/
+MYSQL* SqlConPool::try_checkout() {
+    int slot;
+    while ((slot = pop_free()) >= 0) {
+        if (now_ms() - last_used_[slot] > PING_IDLE_MS && mysql_ping(&conns_[slot])) {
+            LOG_WARN("Mysql connection lost: %s", mysql_error(&conns_[slot]));
+            close_slot(slot);
+            states_[slot] = SLOT_BROKEN;
+            continue;
+        }
+        states_[slot] = SLOT_BUSY;
+        break;
     }
-    MAX_CONNECTIONS_ = con_size;
-    sem_init(&sem_, 0, MAX_CONNECTIONS_);
+    if (slot < 0) slot = try_grow();
+    if (slot < 0) return nullptr;
+
+    int busy = ++busy_count_;
+    int peak = peak_busy_.load(std::memory_order_relaxed);
+    while (busy > peak && !peak_busy_.compare_exchange_weak(peak, busy)) {}
+    return &conns_[slot];
 }
 
 MYSQL* SqlConPool::get_connection() {
-    MYSQL *sql = nullptr;
-    if (conn_queue_.empty()) {
-        LOG_WARN("Mysqlpool busy!");
+    return get_connection(timeout_ms_);
+}
+
+/**
+ * 取连接，没有可用连接时最多等待timeout_ms，超时返回nullptr
+*/
+MYSQL* SqlConPool::get_connection(int timeout_ms) {
+    if (!conns_) return nullptr;
+
+    auto begin = SteadyClock::now();
+    auto deadline = begin + std::chrono::milliseconds(std::max(timeout_ms, 0));
+    MYSQL* sql = try_checkout();
+    while (!sql) {
+        if (timeout_ms >= 0 && SteadyClock::now() >= deadline) break;
+        {
+            //先登记等待者再检查空闲数，与归还连接时先加空闲数再检查等待者配对，不会漏掉唤醒
+            std::unique_lock<std::mutex> lock(wait_mtx_);
+            waiters_++;
+            if (free_count_ == 0) {
+                if (timeout_ms < 0) cond_free_.wait(lock);
+                else cond_free_.wait_until(lock, deadline);
+            }
+            waiters_--;
+        }
+        sql = try_checkout();
     }
-    sem_wait(&sem_);
-    {
-        std::lock_guard<std::mutex> lock(mtx_);
-        sql = conn_queue_.front();
-        conn_queue_.pop();
+
+    uint64_t wait_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                            SteadyClock::now() - begin).count();
+    wait_time_us_.fetch_add(wait_us, std::memory_order_relaxed);
+    if (sql) {
+        checkout_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+        timeout_count_.fetch_add(1, std::memory_order_relaxed);
+        LOG_WARN("Mysqlpool busy, get connection timeout!");
     }
     return sql;
 }
 
 int SqlConPool::get_free_connection_count() {
-    std::lock_guard<std::mutex> lock(mtx_);
-    return conn_queue_.size();
+    return free_count_;
 }
 
 void SqlConPool::free_connection(MYSQL* connection) {
     assert(connection);
-    std::lock_guard<std::mutex> lock(mtx_);
-    conn_queue_.push(connection);
-    sem_post(&sem_);
+    busy_count_--;
+    push_free(get_slot(connection));
+}
+
+/**
+ * 获取连接上query对应的预处理语句，第一次使用时prepare并缓存
+ * 调用者必须持有该连接，失败返回nullptr
+*/
+MYSQL_STMT* SqlConPool::get_statement(MYSQL* connection, const char* query) {
+    assert(connection && query);
+    StmtCache& cache = stmts_[get_slot(connection)];
+    auto it = cache.find(query);
+    if (it != cache.end()) return it->second;
+
+    MYSQL_STMT* stmt = mysql_stmt_init(connection);
+    if (!stmt) {
+        LOG_ERROR("Mysql stmt init error");
+        return nullptr;
+    }
+    if (mysql_stmt_prepare(stmt, query, strlen(query))) {
+        LOG_ERROR("Mysql prepare error: %s", mysql_stmt_error(stmt));
+        mysql_stmt_close(stmt);
+        return nullptr;
+    }
+    cache[query] = stmt;
+    return stmt;
+}
+
+/**
+ * 执行出错(如连接断开)后丢弃预处理语句，下次使用时重新prepare
+*/
+void SqlConPool::discard_statement(MYSQL* connection, const char* query) {
+    StmtCache& cache = stmts_[get_slot(connection)];
+    auto it = cache.find(query);
+    if (it == cache.end()) return;
+    mysql_stmt_close(it->second);
+    cache.erase(it);
+}
+
+/**
+ * 后台维护线程任务函数
+*/
+void SqlConPool::maintain_thread(SqlConPool* pool) {
+    pool->maintain();
+}
+
+/**
+ * 定期重连失效的连接，补足最小连接数，收缩长时间用不到的多余连接
+*/
+void SqlConPool::maintain() {
+    int64_t last_shrink = now_ms();
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(maintain_mtx_);
+            cond_maintain_.wait_for(lock, std::chrono::milliseconds(MAINTAIN_INTERVAL_MS),
+                                    [this] { return is_close_; });
+            if (is_close_) break;
+        }
+
+        for (int i = 0; i < max_size_; i++) {
+            int state = SLOT_BROKEN;
+            if (!states_[i].compare_exchange_strong(state, SLOT_CONNECTING)) continue;
+            if (connect_slot(i)) {
+                LOG_INFO("Mysql connection %d reconnected", i);
+                push_free(i);
+            }
+            else {
+                states_[i] = SLOT_BROKEN;
+            }
+        }
+
+        while (open_count_ < min_size_) {
+            int slot = try_grow();
+            if (slot < 0) break;
+            push_free(slot);
+        }
+
+        if (now_ms() - last_shrink >= SHRINK_IDLE_MS) {
+            shrink();
+            last_shrink = now_ms();
+        }
+    }
+}
+
+/**
+ * 关闭上一个周期内峰值之外的空闲连接，不低于最小连接数
+*/
+void SqlConPool::shrink() {
+    int keep = std::max(peak_busy_.load(), min_size_);
+    peak_busy_ = busy_count_.load();
+    int excess = open_count_ - keep;
+    for (int i = 0; i < excess; i++) {
+        int slot = pop_free();
+        if (slot < 0) break;
+        close_slot(slot);
+        states_[slot] = SLOT_EMPTY;
+        open_count_--;
+    }
+    if (excess > 0) LOG_INFO("Mysqlpool shrink to %d connections", static_cast<int>(open_count_));
 }
 
 void SqlConPool::close_pool() {
-    std::lock_guard<std::mutex> lock(mtx_);
-    while (conn_queue_.size()) {
-        auto item = conn_queue_.front();
-        conn_queue_.pop();
-        mysql_close(item);
+    if (!conns_ || !maintain_thread_) return;
+    {
+        std::lock_guard<std::mutex> lock(maintain_mtx_);
+        is_close_ = true;
+    }
+    cond_maintain_.notify_all();
+    maintain_thread_->join();
+    maintain_thread_.reset();
+
+    int slot;
+    while ((slot = pop_free()) >= 0) {
+        close_slot(slot);
+        states_[slot] = SLOT_EMPTY;
+        open_count_--;
     }
     mysql_library_end();
-}
\ No newline at end of file
+}
+
+int SqlConPool::get_open_count() const {
+    return open_count_;
+}
+
+int SqlConPool::get_busy_count() const {
+    return busy_count_;
+}
+
+double SqlConPool::get_utilization() const {
+    int open = open_count_;
+    return open > 0 ? static_cast<double>(busy_count_) / open : 0.0;
+}
+
+uint64_t SqlConPool::get_checkout_count() const {
+    return checkout_count_.load(std::memory_order_relaxed);
+}
+
+uint64_t SqlConPool::get_timeout_count() const {
+    return timeout_count_.load(std::memory_order_relaxed);
+}
+
+uint64_t SqlConPool::get_wait_time_us() const {
+    return wait_time_us_.load(std::memory_order_relaxed);
+}
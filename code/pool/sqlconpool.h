@@ -6,35 +6,115 @@
 #define __SQLCONPOOL_H_
 
 #include <mysql/mysql.h>
-#include <queue>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <condition_variable>
 #include <assert.h>
-#include <semaphore.h>
 #include "../log/log.h"
 
+/**
+ * 数据库连接池
+ * 连接数在min和max之间伸缩，空闲连接放在无锁栈中，取连接的快路径不加锁
+ * 空闲较久的连接交出前先ping，失效的连接由后台线程重连
+ * 没有可用连接时最多等待超时时间，超时返回nullptr
+*/
 class SqlConPool {
 public:
     static SqlConPool * instance();
 
     MYSQL* get_connection();
+    MYSQL* get_connection(int timeout_ms);
     void free_connection(MYSQL* connection);
     int get_free_connection_count();
 
+    //预处理语句按连接缓存，每个连接每条语句只prepare一次
+    MYSQL_STMT* get_statement(MYSQL* connection, const char* query);
+    void discard_statement(MYSQL* connection, const char* query);
+
     void init(const char* host, int port,
               const char* user, const char* password,
-              const char* db_name, int con_size);
+              const char* db_name, int min_size,
+              int max_size = 0, int timeout_ms = 1000);
     void close_pool();
 
-private:    
+    //监控指标
+    int get_open_count() const;
+    int get_busy_count() const;
+    double get_utilization() const;//正在使用的连接占已打开连接的比例
+    uint64_t get_checkout_count() const;
+    uint64_t get_timeout_count() const;
+    uint64_t get_wait_time_us() const;//取连接累计等待时间
+
+private:
     SqlConPool();
     ~SqlConPool();
 
+    typedef std::unordered_map<std::string, MYSQL_STMT*> StmtCache;
+    typedef std::chrono::steady_clock SteadyClock;
+
+    enum SLOT_STATE {
+        SLOT_EMPTY,//没有连接，可以在此新建连接
+        SLOT_CONNECTING,
+        SLOT_IDLE,//在空闲栈中
+        SLOT_BUSY,//被取出使用
+        SLOT_BROKEN,//连接失败或失效，等待后台重连
+    };
+
+    int get_slot(MYSQL* connection) const;
+    bool connect_slot(int slot);
+    void close_slot(int slot);
+    void push_free(int slot);
+    int pop_free();
+    int try_grow();
+    MYSQL* try_checkout();
+
+    static void maintain_thread(SqlConPool* pool);
+    void maintain();
+    void shrink();
+
 private:
-    int MAX_CONNECTIONS_;
+    static const int PING_IDLE_MS = 3000;//空闲超过这个时间的连接交出前先ping
+    static const int SHRINK_IDLE_MS = 60000;//这段时间内用不到的多余连接被关闭
+    static const int MAINTAIN_INTERVAL_MS = 1000;
+
+    std::string host_, user_, password_, db_name_;
+    int port_;
+    int min_size_;
+    int max_size_;
+    int timeout_ms_;
+
+    //连接放在固定槽位中，MYSQL结构体地址不变，用地址换算槽位下标
+    std::unique_ptr<MYSQL[]> conns_;
+    std::unique_ptr<std::atomic<int>[]> states_;
+    std::unique_ptr<std::atomic<uint32_t>[]> next_;//空闲栈中下一个槽位，0为栈底
+    std::unique_ptr<std::atomic<int64_t>[]> last_used_;//最近一次归还的时间(ms)
+    std::unique_ptr<StmtCache[]> stmts_;//只有持有该连接的线程访问
+
+    //空闲栈栈顶：高32位为版本号防止ABA，低32位为槽位下标+1
+    std::atomic<uint64_t> free_head_;
+    std::atomic<int> free_count_;
+    std::atomic<int> open_count_;//非EMPTY的槽位数
+    std::atomic<int> busy_count_;
+    std::atomic<int> peak_busy_;//收缩检查周期内的最大使用数
+
+    //慢路径：没有空闲连接时等待
+    std::mutex wait_mtx_;
+    std::condition_variable cond_free_;
+    std::atomic<int> waiters_;
+
+    std::atomic<uint64_t> checkout_count_;
+    std::atomic<uint64_t> timeout_count_;
+    std::atomic<uint64_t> wait_time_us_;
 
-    std::queue<MYSQL *> conn_queue_;
-    std::mutex mtx_;
-    sem_t sem_;
+    std::mutex maintain_mtx_;
+    std::condition_variable cond_maintain_;
+    std::unique_ptr<std::thread> maintain_thread_;
+    bool is_close_;
 };
 
-#endif // !__SQLCONPOOL_H_
\ No newline at end of file
+#endif // !__SQLCONPOOL_H_
@@ -9,62 +9,206 @@
 #include <thread>
 #include <mutex>
 #include <queue>
+#include <vector>
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <memory>
 #include <condition_variable>
+#include <stdint.h>
+#include <assert.h>
 
+/**
+ * 线程池
+ * max_queue为0时任务队列不限长度；否则队列满时按策略处理：
+ *   OVERFLOW_BLOCK      阻塞提交者直到有空位，工作线程不能向自己所在的线程池提交，否则可能死锁
+ *   OVERFLOW_REJECT     不执行任务，调用拒绝回调(如果设置了)后add_task返回false
+ *   OVERFLOW_RUN_INLINE 在提交者线程中直接执行
+ * 每个任务从入队到开始执行的等待时间记录在按2的幂分桶的直方图中
+ * thread_init在每个工作线程开始取任务前调用，参数是线程序号，可用于绑核
+ * 析构时不再接受新任务，等工作线程执行完队列中已有的任务后退出
+*/
 class ThreadPool {
 public:
-    ThreadPool(int max_thread_num = 1) : pool_(std::make_shared<struct pool>()) {
+    enum OVERFLOW_POLICY {
+        OVERFLOW_BLOCK = 0,
+        OVERFLOW_REJECT,
+        OVERFLOW_RUN_INLINE,
+    };
+
+    typedef std::function<void()> Task;
+    typedef std::function<void(Task&)> RejectCallback;
+    typedef std::function<void(int)> ThreadInit;
+
+    //第i个桶统计等待时间在[2^(i-1), 2^i)微秒内的任务，第0个桶小于1微秒，最后一个桶不设上限
+    static const int WAIT_BUCKETS = 24;
+
+    explicit ThreadPool(int max_thread_num = 1, size_t max_queue = 0,
+                        OVERFLOW_POLICY policy = OVERFLOW_BLOCK,
+                        ThreadInit thread_init = nullptr) : pool_(std::make_shared<struct pool>()) {
         assert(max_thread_num > 0);
+        pool_->max_queue = max_queue;
+        pool_->policy = policy;
         for (int i = 0; i < max_thread_num; i++) {
-            std::thread(std::bind(&ThreadPool::do_task, this)).detach();
-        }
-    }
-    void do_task() {
-        std::unique_lock<std::mutex> lock(pool_->mtx_);
-        while (true) {
-            if (pool_->tasks.size()) {
-                auto task = std::move(pool_->tasks.front());
-                pool_->tasks.pop();
-                lock.unlock();
-                task();
-                lock.lock();
-            }
-            else if (pool_->is_close_) break;
-            else pool_->cond.wait(lock);
+            threads_.emplace_back(&ThreadPool::do_task, pool_, i, thread_init);
         }
     }
 
-    ThreadPool() = default;
     ThreadPool(ThreadPool&&) = default;
     ~ThreadPool() {
-        if (static_cast<bool>(pool_)) {
-            {
-                std::lock_guard<std::mutex> lock(pool_->mtx_);
-                pool_->is_close_ = true;
-            }
-            pool_->cond.notify_all();
+        shutdown();
+    }
+
+    //停止接受任务并等待工作线程执行完剩余任务，可重复调用
+    //在工作线程中调用时不能等待自己，该线程被分离，它只持有共享的pool，仍可安全退出
+    void shutdown() {
+        if (!static_cast<bool>(pool_)) return;
+        {
+            std::lock_guard<std::mutex> lock(pool_->mtx_);
+            pool_->is_close_ = true;
+        }
+        pool_->cond.notify_all();
+        pool_->not_full.notify_all();
+        for (std::thread& t : threads_) {
+            if (!t.joinable()) continue;
+            if (t.get_id() == std::this_thread::get_id()) t.detach();
+            else t.join();
         }
     }
 
+    //拒绝回调在提交者线程中调用，参数是被拒绝的任务
+    void set_reject_callback(RejectCallback cb) {
+        std::lock_guard<std::mutex> lock(pool_->mtx_);
+        pool_->reject_cb = std::move(cb);
+    }
+
+    //任务被执行或已入队时返回true
     template <typename T>
-    void add_task(T&& task) {
+    bool add_task(T&& task) {
         {
-            std::lock_guard<std::mutex> lock(pool_->mtx_);
-            pool_->tasks.emplace(std::forward<T>(task));
+            std::unique_lock<std::mutex> lock(pool_->mtx_);
+            if (pool_->is_close_) return false;
+            if (pool_->max_queue > 0 && pool_->tasks.size() >= pool_->max_queue) {
+                if (pool_->policy == OVERFLOW_BLOCK) {
+                    pool_->blocked++;
+                    pool_->not_full.wait(lock, [this] {
+                        return pool_->is_close_ || pool_->tasks.size() < pool_->max_queue;
+                    });
+                    if (pool_->is_close_) return false;
+                }
+                else {
+                    RejectCallback cb = pool_->reject_cb;
+                    lock.unlock();
+                    Task t(std::forward<T>(task));
+                    if (pool_->policy == OVERFLOW_RUN_INLINE) {
+                        pool_->inlined.fetch_add(1, std::memory_order_relaxed);
+                        t();
+                        return true;
+                    }
+                    pool_->rejected.fetch_add(1, std::memory_order_relaxed);
+                    if (cb) cb(t);
+                    return false;
+                }
+            }
+            pool_->tasks.push({Task(std::forward<T>(task)), SteadyClock::now()});
         }
         pool_->cond.notify_one();
+        return true;
+    }
+
+    //排队等待执行的任务数
+    size_t get_queue_size() {
+        std::lock_guard<std::mutex> lock(pool_->mtx_);
+        return pool_->tasks.size();
+    }
+
+    //监控指标
+    uint64_t get_task_count() const { return pool_->executed.load(std::memory_order_relaxed); }
+    uint64_t get_rejected_count() const { return pool_->rejected.load(std::memory_order_relaxed); }
+    uint64_t get_inline_count() const { return pool_->inlined.load(std::memory_order_relaxed); }
+    uint64_t get_blocked_count() {
+        std::lock_guard<std::mutex> lock(pool_->mtx_);
+        return pool_->blocked;
+    }
+    void get_wait_histogram(uint64_t (&buckets)[WAIT_BUCKETS]) const {
+        for (int i = 0; i < WAIT_BUCKETS; i++) {
+            buckets[i] = pool_->wait_hist[i].load(std::memory_order_relaxed);
+        }
+    }
+    //等待时间的分位数，返回所在桶的上界(微秒)，没有任务时返回0
+    uint64_t get_wait_percentile_us(double p) const {
+        uint64_t buckets[WAIT_BUCKETS], total = 0;
+        get_wait_histogram(buckets);
+        for (int i = 0; i < WAIT_BUCKETS; i++) total += buckets[i];
+        if (total == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(p * total), seen = 0;
+        for (int i = 0; i < WAIT_BUCKETS; i++) {
+            seen += buckets[i];
+            if (seen > rank) return 1ull << i;
+        }
+        return 1ull << (WAIT_BUCKETS - 1);
     }
 
 private:
+    typedef std::chrono::steady_clock SteadyClock;
+
+    struct Item {
+        Task task;
+        SteadyClock::time_point enqueue_time;
+    };
+
     struct pool {
         std::mutex mtx_;
         std::condition_variable cond;
-        std::queue<std::function<void()>> tasks;
-        bool is_close_;
+        std::condition_variable not_full;
+        std::queue<Item> tasks;
+        bool is_close_ = false;
+
+        size_t max_queue = 0;
+        OVERFLOW_POLICY policy = OVERFLOW_BLOCK;
+        RejectCallback reject_cb;
+
+        uint64_t blocked = 0;//加锁访问
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> rejected{0};
+        std::atomic<uint64_t> inlined{0};
+        std::atomic<uint64_t> wait_hist[WAIT_BUCKETS] = {};
     };
+
+    static int wait_bucket(uint64_t wait_us) {
+        int i = 0;
+        while (wait_us > 0 && i < WAIT_BUCKETS - 1) {
+            wait_us >>= 1;
+            i++;
+        }
+        return i;
+    }
+
+    static void do_task(std::shared_ptr<struct pool> pool, int index, ThreadInit thread_init) {
+        if (thread_init) thread_init(index);
+        std::unique_lock<std::mutex> lock(pool->mtx_);
+        while (true) {
+            if (pool->tasks.size()) {
+                Item item = std::move(pool->tasks.front());
+                pool->tasks.pop();
+                bool notify = pool->max_queue > 0;
+                lock.unlock();
+                if (notify) pool->not_full.notify_one();
+
+                uint64_t wait_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                        SteadyClock::now() - item.enqueue_time).count();
+                pool->wait_hist[wait_bucket(wait_us)].fetch_add(1, std::memory_order_relaxed);
+                pool->executed.fetch_add(1, std::memory_order_relaxed);
+                item.task();
+                lock.lock();
+            }
+            else if (pool->is_close_) break;
+            else pool->cond.wait(lock);
+        }
+    }
+
     std::shared_ptr<struct pool> pool_;
+    std::vector<std::thread> threads_;
 };
 
-#endif // !__THREADPOOL_H__
\ No newline at end of file
+#endif // !__THREADPOOL_H__
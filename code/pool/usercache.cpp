@@ -0,0 +1,125 @@
+/**
+
+ * @Date    :       2020-12-29
+*/
+
+#include "usercache.h"
+
+UserCache::UserCache() : ttl_(60000), negative_ttl_(5000),
+        shard_capacity_(65536 / SHARD_NUM), hits_(0), misses_(0) {
+
+}
+
+/**
+ * 单例模式，全局实例化一个用户缓存
+*/
+UserCache* UserCache::instance() {
+    static UserCache inst;
+    return &inst;
+}
+
+/**
+ * ttl_ms：已存在用户的有效期
+ * negative_ttl_ms：不存在用户的有效期，为0时不缓存不存在的用户
+ * max_entries：缓存条目上限，平均分到各分片
+*/
+void UserCache::init(int ttl_ms, int negative_ttl_ms, size_t max_entries) {
+    ttl_ = std::chrono::milliseconds(ttl_ms);
+    negative_ttl_ = std::chrono::milliseconds(negative_ttl_ms);
+    shard_capacity_ = max_entries / SHARD_NUM;
+    if (shard_capacity_ == 0) shard_capacity_ = 1;
+}
+
+UserCache::Shard& UserCache::get_shard(const std::string& name) {
+    return shards_[std::hash<std::string>()(name) % SHARD_NUM];
+}
+
+/**
+ * 查询用户，存在时取出密码
+ * 过期条目顺便删除
+*/
+UserCache::LOOKUP UserCache::get(const std::string& name, std::string& password) {
+    if (ttl_.count() > 0) {
+        Shard& shard = get_shard(name);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        auto it = shard.users.find(name);
+        if (it != shard.users.end()) {
+            if (it->second.expire > SteadyClock::now()) {
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                if (!it->second.exist) return CACHE_NOT_EXIST;
+                password = it->second.password;
+                return CACHE_FOUND;
+            }
+            shard.users.erase(it);
+        }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return CACHE_MISS;
+}
+
+/**
+ * 缓存从数据库查到的用户
+*/
+void UserCache::put(const std::string& name, const std::string& password) {
+    if (ttl_.count() <= 0) return;
+    insert(name, Entry{password, true, SteadyClock::now() + ttl_});
+}
+
+/**
+ * 缓存数据库中不存在的用户名
+*/
+void UserCache::put_not_exist(const std::string& name) {
+    if (negative_ttl_.count() <= 0) return;
+    insert(name, Entry{std::string(), false, SteadyClock::now() + negative_ttl_});
+}
+
+/**
+ * 分片满时淘汰一个条目，最多检查EVICT_SCAN个条目，优先淘汰已过期的
+ * 不做全表扫描，避免缓存满后每次插入的开销随容量增长
+*/
+void UserCache::insert(const std::string& name, const Entry& entry) {
+    Shard& shard = get_shard(name);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    if (shard.users.size() >= shard_capacity_ && !shard.users.count(name)) {
+        auto now = SteadyClock::now();
+        auto victim = shard.users.begin();
+        auto it = victim;
+        for (int i = 0; i < EVICT_SCAN && it != shard.users.end(); i++, ++it) {
+            if (it->second.expire <= now) {
+                victim = it;
+                break;
+            }
+        }
+        shard.users.erase(victim);
+    }
+    shard.users[name] = entry;
+}
+
+/**
+ * 用户信息变化(如注册)后删除缓存条目
+*/
+void UserCache::invalidate(const std::string& name) {
+    Shard& shard = get_shard(name);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    shard.users.erase(name);
+}
+
+uint64_t UserCache::get_hit_count() const {
+    return hits_.load(std::memory_order_relaxed);
+}
+
+uint64_t UserCache::get_miss_count() const {
+    return misses_.load(std::memory_order_relaxed);
+}
+
+/**
+ * 获取当前缓存条目数，含未清理的过期条目
+*/
+size_t UserCache::size() {
+    size_t n = 0;
+    for (int i = 0; i < SHARD_NUM; i++) {
+        std::lock_guard<std::mutex> lock(shards_[i].mtx);
+        n += shards_[i].users.size();
+    }
+    return n;
+}
@@ -0,0 +1,76 @@
+/**
+
+ * @Date    :       2020-12-29
+*/
+
+#ifndef __USERCACHE_H_
+#define __USERCACHE_H_
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+
+/**
+ * 用户信息缓存，挡在数据库前面
+ * 按用户名哈希分片，每个分片一把锁，缓存已存在用户的密码，
+ * 也缓存不存在的用户名（较短的有效期），注册成功后使对应条目失效
+*/
+class UserCache {
+public:
+    enum LOOKUP {
+        CACHE_MISS,//没有缓存或已过期，需要查询数据库
+        CACHE_FOUND,//用户存在
+        CACHE_NOT_EXIST,//用户不存在
+    };
+
+    static UserCache* instance();
+
+    void init(int ttl_ms = 60000, int negative_ttl_ms = 5000, size_t max_entries = 65536);
+
+    LOOKUP get(const std::string& name, std::string& password);
+    void put(const std::string& name, const std::string& password);
+    void put_not_exist(const std::string& name);
+    void invalidate(const std::string& name);
+
+    uint64_t get_hit_count() const;
+    uint64_t get_miss_count() const;
+    size_t size();
+
+private:
+    UserCache();
+    ~UserCache() = default;
+
+    typedef std::chrono::steady_clock SteadyClock;
+
+    struct Entry {
+        std::string password;
+        bool exist;
+        SteadyClock::time_point expire;
+    };
+
+    struct Shard {
+        std::mutex mtx;
+        std::unordered_map<std::string, Entry> users;
+        char pad[64];//分片锁之间隔开，避免伪共享
+    };
+
+    Shard& get_shard(const std::string& name);
+    void insert(const std::string& name, const Entry& entry);
+
+private:
+    static const int SHARD_NUM = 16;
+    static const int EVICT_SCAN = 8;//淘汰时最多检查的条目数
+
+    Shard shards_[SHARD_NUM];
+    std::chrono::milliseconds ttl_;
+    std::chrono::milliseconds negative_ttl_;
+    size_t shard_capacity_;//每个分片最多缓存的条目数
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+};
+
+#endif // !__USERCACHE_H_
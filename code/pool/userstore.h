@@ -0,0 +1,30 @@
+/**
+
+ * @Date    :       2020-12-30
+*/
+
+#ifndef __USERSTORE_H_
+#define __USERSTORE_H_
+
+#include <string>
+
+/**
+ * 用户存储接口，登录注册通过它读写用户，不关心后端是MySQL还是本地文件
+ * 实现需要线程安全
+*/
+class UserStore {
+public:
+    enum RESULT {
+        STORE_OK,
+        STORE_NOT_FOUND,//查询的用户不存在
+        STORE_EXIST,//注册的用户名已被使用
+        STORE_ERROR,
+    };
+
+    virtual ~UserStore() = default;
+
+    virtual RESULT find_user(const std::string& name, std::string& password) = 0;
+    virtual RESULT add_user(const std::string& name, const std::string& password) = 0;
+};
+
+#endif // !__USERSTORE_H_
@@ -0,0 +1,69 @@
+/**
+
+ * @Date    :       2021-01-05
+*/
+
+#include "admission.h"
+
+AdmissionControl::AdmissionControl() : loop_lag_us_(0), admitted_(0), shed_{0} {
+    set_limits(Limits());
+}
+
+/**
+ * 设置阈值并重新生成503响应
+*/
+void AdmissionControl::set_limits(const Limits& limits) {
+    static const char BODY[] = "503 Service Unavailable: server overloaded, please retry later.\n";
+    limits_ = limits;
+    busy_response_ = "HTTP/1.1 503 Service Unavailable\r\n";
+    if (limits_.retry_after_s > 0) {
+        busy_response_ += "Retry-After: " + std::to_string(limits_.retry_after_s) + "\r\n";
+    }
+    busy_response_ += "Connection: close\r\n";
+    busy_response_ += "Content-type: text/plain\r\n";
+    busy_response_ += "Content-length: " + std::to_string(sizeof(BODY) - 1) + "\r\n\r\n";
+    busy_response_ += BODY;
+}
+
+/**
+ * 判断是否接受新连接
+ * 事件循环延迟只在有连接时才有意义，空闲时不会因为偶尔的慢循环拒绝连接
+*/
+bool AdmissionControl::admit(int conn, size_t queue, int inflight, REASON* reason) {
+    REASON r = SHED_REASON_NUM;
+    if (limits_.max_conn > 0 && conn >= limits_.max_conn) r = SHED_CONN;
+    else if (limits_.max_queue > 0 && queue >= static_cast<size_t>(limits_.max_queue)) r = SHED_QUEUE;
+    else if (limits_.max_inflight > 0 && inflight >= limits_.max_inflight) r = SHED_INFLIGHT;
+    else if (limits_.max_loop_lag_ms > 0 && conn > 0
+             && loop_lag_us_ >= static_cast<int64_t>(limits_.max_loop_lag_ms) * 1000) r = SHED_LOOP_LAG;
+
+    if (r == SHED_REASON_NUM) {
+        admitted_++;
+        return true;
+    }
+    shed(r);
+    if (reason) *reason = r;
+    return false;
+}
+
+void AdmissionControl::shed(REASON reason) {
+    shed_[reason]++;
+}
+
+/**
+ * 指数平滑事件循环的忙碌时间
+*/
+void AdmissionControl::record_loop(int64_t busy_us) {
+    loop_lag_us_ += (busy_us - loop_lag_us_) >> LAG_SMOOTH_SHIFT;
+}
+
+uint64_t AdmissionControl::get_shed_count() const {
+    uint64_t total = 0;
+    for (int i = 0; i < SHED_REASON_NUM; i++) total += shed_[i];
+    return total;
+}
+
+const char* AdmissionControl::reason_name(REASON reason) {
+    static const char* NAMES[SHED_REASON_NUM] = { "conn", "queue", "inflight", "loop_lag", "fd" };
+    return reason < SHED_REASON_NUM ? NAMES[reason] : "unknown";
+}
@@ -0,0 +1,70 @@
+/**
+
+ * @Date    :       2021-01-05
+*/
+
+#ifndef __ADMISSION_H_
+#define __ADMISSION_H_
+
+#include <string>
+#include <stdint.h>
+
+/**
+ * 准入控制
+ * 在接受新连接时按连接数、任务队列长度、处理中的请求数和事件循环延迟判断是否过载，
+ * 过载时只拒绝新连接，已经建立的连接照常处理
+ * 所有方法只在事件循环线程中调用
+*/
+class AdmissionControl {
+public:
+    //阈值，0表示不检查该项
+    struct Limits {
+        int max_conn = 0;//同时保持的连接数
+        int max_queue = 4096;//线程池中排队的任务数
+        int max_inflight = 0;//已收到完整请求、还没发送完响应的请求数
+        int max_loop_lag_ms = 100;//事件循环处理一批事件的平滑耗时
+        int retry_after_s = 1;//503响应中的Retry-After
+    };
+
+    enum REASON {
+        SHED_CONN = 0,
+        SHED_QUEUE,
+        SHED_INFLIGHT,
+        SHED_LOOP_LAG,
+        SHED_FD,//进程文件描述符耗尽
+        SHED_REASON_NUM,
+    };
+
+    AdmissionControl();
+    ~AdmissionControl() = default;
+
+    void set_limits(const Limits& limits);
+    const Limits& get_limits() const { return limits_; }
+
+    //返回true时接受连接，否则reason为拒绝原因
+    bool admit(int conn, size_t queue, int inflight, REASON* reason);
+    void shed(REASON reason);//记录一次拒绝
+    void record_loop(int64_t busy_us);//记录一轮事件处理的耗时
+
+    //预先生成的503响应，拒绝时直接发送，不分配内存
+    const std::string& get_busy_response() const { return busy_response_; }
+
+    uint64_t get_admitted_count() const { return admitted_; }
+    uint64_t get_shed_count() const;
+    uint64_t get_shed_count(REASON reason) const { return shed_[reason]; }
+    int64_t get_loop_lag_us() const { return loop_lag_us_; }
+
+    static const char* reason_name(REASON reason);
+
+private:
+    static const int LAG_SMOOTH_SHIFT = 3;//指数平滑系数1/8
+
+    Limits limits_;
+    std::string busy_response_;
+
+    int64_t loop_lag_us_;
+    uint64_t admitted_;
+    uint64_t shed_[SHED_REASON_NUM];
+};
+
+#endif // !__ADMISSION_H_
@@ -3,12 +3,20 @@
 */
 #include "webserver.h"
 
-WebServer::WebServer(
-        int port, int trig_mode, int timeout_ms, bool opt_linger,
-        int thread_num, bool open_log, int log_level, int log_queue_size) : 
-        port_(port), opt_linger_(opt_linger), timeout_ms_(timeout_ms), is_close_(false),
-        timer_(new HeapTimer()), threadpool_(new ThreadPool(thread_num)),epoller_(new Epoller())
+const char* WebServer::LISTEN_FD_ENV = "WEBSERVER_LISTEN_FD";
+const char* WebServer::READY_FD_ENV = "WEBSERVER_READY_FD";
+
+WebServer::WebServer(const Config& config) :
+        config_(config), port_(config.get_int("port")), opt_linger_(config.get_bool("opt_linger")),
+        timeout_ms_(config.get_int("timeout_ms")), min_timeout_ms_(0), max_conn_(MAX_FD), is_close_(false),
+        listen_fd_(-1), idle_fd_(-1), signal_fd_(-1),
+        is_draining_(false), drain_timeout_ms_(0), restart_pid_(-1), restart_fd_(-1), stats_interval_ms_(0),
+        timer_(new HeapTimer()), epoller_(new Epoller()),
+        max_auth_pending_(config.get_int("max_auth_pending")), auth_pending_(0), auth_event_fd_(-1)
 {
+    //信号由事件循环通过signalfd处理，必须在创建任何线程之前屏蔽，线程会继承信号掩码
+    if (!init_signal()) is_close_ = true;
+
     src_dir_ = getcwd(nullptr, 256);
     assert (src_dir_);
     strncat(src_dir_, "/resources", 16);
@@ -16,40 +24,236 @@ WebServer::WebServer(
     //设置http响应文件的路径
     HttpConn::src_dir = src_dir_;
     HttpConn::user_count = 0;
+    HttpConn::buffer_size = config_.get_int("buffer_size");
+
+    //能同时保持的连接数还受进程文件描述符上限限制，留出日志、监听、发送文件等用的fd
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY
+        && limit.rlim_cur < static_cast<rlim_t>(MAX_FD)) {
+        int nofile = static_cast<int>(limit.rlim_cur);
+        max_conn_ = nofile - std::min(FD_RESERVE, nofile / 4);
+    }
+    idle_fd_ = open("/dev/null", O_RDONLY|O_CLOEXEC);
+
+    //是否开启日志系统，在绑核、预加载和监听之前打开，它们出错时才能记录原因；写线程要在屏蔽信号之后创建
+    const char* log_dir = config_.get_string("log_dir").c_str();
+    int access_sample_rate = config_.get_int("access_sample_rate");
+    if(config_.get_bool("open_log")) {
+        Log::RotatePolicy rotate;
+        rotate.max_bytes = config_.get_int("log_rotate_max_bytes");
+        rotate.max_lines = config_.get_int("log_rotate_max_lines");
+        rotate.interval_sec = config_.get_int("log_rotate_interval_sec");
+        rotate.compress = config_.get_bool("log_rotate_compress");
+        rotate.max_files = config_.get_int("log_rotate_max_files");
+        Log::instance()->set_rotate_policy(rotate);
+        Log::instance()->init(config_.get_int("log_level"), log_dir, ".log", config_.get_int("log_queue_size"));
+        //访问日志，采样率为0时关闭
+        if (access_sample_rate > 0) {
+            AccessLog::instance()->init(log_dir, access_sample_rate);
+        }
+    }
+
+    //可重载的配置：超时、长连接、准入控制、文件缓存大小；缓存大小要在预加载之前设置
+    apply_config();
 
     //设置端口监听和读写事件的触发模式
-    init_event_mode(trig_mode);
+    init_event_mode(config_.get_int("trig_mode"));
+
+    //绑核要在创建工作线程之前确定
+    if (!init_affinity(config_.get_cstr("reactor_cpus"), config_.get_cstr("worker_cpus"))) is_close_ = true;
+    int thread_num = config_.get_int("thread_num");
+    threadpool_.reset(new ThreadPool(thread_num, config_.get_int("worker_queue_size"),
+                                     ThreadPool::OVERFLOW_RUN_INLINE,
+                                     std::bind(&WebServer::pin_worker, this, std::placeholders::_1)));
+
+    //追加配置的MIME类型，要在预加载之前，缓存条目中记录了类型
+    const std::string& mime_file = config_.get_string("mime_file");
+    int mime_num = mime_file.empty() ? -1 : MimeType::load(mime_file.c_str());
+
+    //预先加载并压缩静态文件
+    FileCache::instance()->preload(src_dir_);
 
     //初始化本地端口监听
     if (!init_socket()) is_close_ = true;
 
-    //是否开启日志系统
-    if(open_log) {
-        Log::instance()->init(log_level, "./log", ".log", log_queue_size);  
+    //Cache-Control规则只在启动时加载，工作线程读取时不加锁
+    if (!HttpResponse::load_cache_control(config_.get_string("cache_control"))) {
+        LOG_ERROR("invalid cache_control: %s", config_.get_string("cache_control").c_str());
+        is_close_ = true;
     }
 
+    //用户存储：配置了数据库时使用MySQL，存储访问在数据库线程中进行；
+    //否则可以使用本地文件存储，访问很快，直接在工作线程中进行；都不配置时登录注册直接失败
+    //密码哈希都在哈希线程中计算
+    const char* sql_host = config_.get_cstr("sql_host");
+    const char* user_db_path = config_.get_cstr("user_db_path");
+    int conn_pool_num = config_.get_int("conn_pool_num");
+    if (sql_host && conn_pool_num > 0) {
+        //平时保持一半连接，忙时扩到conn_pool_num，与数据库线程数相同
+        SqlConPool::instance()->init(sql_host, config_.get_int("sql_port"),
+                                    config_.get_string("sql_user").c_str(),
+                                    config_.get_string("sql_password").c_str(),
+                                    config_.get_string("db_name").c_str(),
+                                    (conn_pool_num+1)/2, conn_pool_num);
+        user_store_.reset(new MysqlUserStore(SqlConPool::instance()));
+    }
+    else if (user_db_path) {
+        LocalUserStore* store = new LocalUserStore();
+        user_store_.reset(store);
+        if (!store->open(user_db_path)) is_close_ = true;
+    }
+    if (!init_auth(sql_host ? conn_pool_num : 0)) is_close_ = true;
+
     //打印启动server日志信息
     if (is_close_) {
         LOG_ERROR("========== WebServer init error!==========");
     }
     else {
         LOG_INFO("========== WebServer init ==========");
-        LOG_INFO("Port:%d, opt_linger: %s", port_, opt_linger? "true":"false");
+        if (!config_.get_path().empty()) LOG_INFO("Config file: %s", config_.get_path().c_str());
+        LOG_INFO("Port:%d, opt_linger: %s", port_, opt_linger_? "true":"false");
         LOG_INFO("Listen Mode: %s, OpenConn Mode: %s",
                         (listen_event_ & EPOLLET ? "ET": "LT"),
                         (conn_event_ & EPOLLET ? "ET": "LT"));
-        LOG_INFO("LogSys level: %d", log_level);
+        LOG_INFO("LogSys level: %d", static_cast<int>(config_.get_int("log_level")));
+        if (access_sample_rate > 0) LOG_INFO("AccessLog sample rate: 1/%d", access_sample_rate);
         LOG_INFO("ThreadPool num: %d",thread_num);
+        if (!reactor_cpus_.empty() || !worker_cpus_.empty()) {
+            LOG_INFO("CPU affinity reactor: [%s], workers: [%s], NUMA: %s",
+                            CpuAffinity::to_string(reactor_cpus_).c_str(),
+                            CpuAffinity::to_string(worker_cpus_).c_str(),
+                            CpuAffinity::is_numa_available() ? "on" : "off");
+        }
+        LOG_INFO("Keep-alive max: %d, idle timeout: %dms (min %dms), max conn: %d",
+                        static_cast<int>(HttpConn::keepalive_max), timeout_ms_, min_timeout_ms_, max_conn_);
+        if (mime_num >= 0) LOG_INFO("MimeType config: %s, %d types", mime_file.c_str(), mime_num);
+        if (sqlpool_) {
+            LOG_INFO("SqlConPool num: %d", conn_pool_num);
+        }
+        else if (user_store_) {
+            LOG_INFO("Local user store: %s", user_db_path);
+        }
+        //热重启启动的进程，文件已预加载，可以接手了
+        notify_ready();
     } 
 }
 
 WebServer::~WebServer() {
-    close(listen_fd_);
+    //先等工作线程处理完，它们可能提交校验任务；数据库和哈希线程的回调会写auth_event_fd_，要在关闭之前停止
+    threadpool_->shutdown();
+    if (sqlpool_) sqlpool_->shutdown();
+    if (hasher_) hasher_->shutdown();
+    //优雅退出超时后剩下的连接
+    for (auto& item : users_) {
+        if (!item.second.is_closed()) close_connection(&item.second);
+    }
+
+    if (listen_fd_ >= 0) close(listen_fd_);
+    if (idle_fd_ >= 0) close(idle_fd_);
+    if (signal_fd_ >= 0) close(signal_fd_);
+    if (restart_fd_ >= 0) close(restart_fd_);
+    if (auth_event_fd_ >= 0) close(auth_event_fd_);
+    log_stats();
     is_close_ = true;
     free(src_dir_);
 }
 
 
+/**
+ * 输出运行指标，计数都是启动以来的累计值
+ * 在事件循环中按stats_interval_ms定期调用，退出时再输出一次
+*/
+void WebServer::log_stats() {
+    LOG_INFO("Connections: %d, requests in flight: %d",
+            static_cast<int>(HttpConn::user_count), static_cast<int>(HttpConn::inflight_count));
+    LOG_INFO("Admission admitted: %llu, shed: %llu (conn %llu, queue %llu, inflight %llu, loop_lag %llu, fd %llu)",
+            static_cast<unsigned long long>(admission_.get_admitted_count()),
+            static_cast<unsigned long long>(admission_.get_shed_count()),
+            static_cast<unsigned long long>(admission_.get_shed_count(AdmissionControl::SHED_CONN)),
+            static_cast<unsigned long long>(admission_.get_shed_count(AdmissionControl::SHED_QUEUE)),
+            static_cast<unsigned long long>(admission_.get_shed_count(AdmissionControl::SHED_INFLIGHT)),
+            static_cast<unsigned long long>(admission_.get_shed_count(AdmissionControl::SHED_LOOP_LAG)),
+            static_cast<unsigned long long>(admission_.get_shed_count(AdmissionControl::SHED_FD)));
+    LOG_INFO("FileCache hit: %llu, miss: %llu, bytes: %llu",
+            static_cast<unsigned long long>(FileCache::instance()->get_hit_count()),
+            static_cast<unsigned long long>(FileCache::instance()->get_miss_count()),
+            static_cast<unsigned long long>(FileCache::instance()->get_bytes()));
+    LOG_INFO("ThreadPool tasks: %llu, queue: %d, inline: %llu, wait p50: <%lluus, p99: <%lluus, p999: <%lluus",
+            static_cast<unsigned long long>(threadpool_->get_task_count()),
+            static_cast<int>(threadpool_->get_queue_size()),
+            static_cast<unsigned long long>(threadpool_->get_inline_count()),
+            static_cast<unsigned long long>(threadpool_->get_wait_percentile_us(0.5)),
+            static_cast<unsigned long long>(threadpool_->get_wait_percentile_us(0.99)),
+            static_cast<unsigned long long>(threadpool_->get_wait_percentile_us(0.999)));
+    if (hasher_) {
+        uint64_t count = hasher_->get_task_count();
+        LOG_INFO("PasswordHasher tasks: %llu, rejected: %llu, avg run: %lluus, avg wait: %lluus, max latency: %lluus",
+                static_cast<unsigned long long>(count),
+                static_cast<unsigned long long>(hasher_->get_rejected_count()),
+                static_cast<unsigned long long>(count ? hasher_->get_run_time_us() / count : 0),
+                static_cast<unsigned long long>(count ? hasher_->get_wait_time_us() / count : 0),
+                static_cast<unsigned long long>(hasher_->get_max_latency_us()));
+    }
+    if (sqlpool_) {
+        LOG_INFO("UserCache hit: %llu, miss: %llu",
+                static_cast<unsigned long long>(UserCache::instance()->get_hit_count()),
+                static_cast<unsigned long long>(UserCache::instance()->get_miss_count()));
+        SqlConPool* pool = SqlConPool::instance();
+        LOG_INFO("SqlConPool checkout: %llu, timeout: %llu, wait: %lluus, open: %d, busy: %d, utilization: %.2f",
+                static_cast<unsigned long long>(pool->get_checkout_count()),
+                static_cast<unsigned long long>(pool->get_timeout_count()),
+                static_cast<unsigned long long>(pool->get_wait_time_us()),
+                pool->get_open_count(), pool->get_busy_count(), pool->get_utilization());
+    }
+}
+
+/**
+ * 到时间时输出运行指标，返回距下次输出的毫秒数
+*/
+int WebServer::check_stats() {
+    auto now = std::chrono::steady_clock::now();
+    if (now >= next_stats_) {
+        log_stats();
+        next_stats_ = now + std::chrono::milliseconds(stats_interval_ms_);
+    }
+    return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(next_stats_ - now).count()) + 1;
+}
+
+
+/**
+ * 解析绑核配置
+ * 只配置了事件循环的CPU时，工作线程默认使用同一NUMA节点的CPU，
+ * 连接的缓冲区由事件循环分配、由工作线程读写，放在同一节点上避免跨节点访存
+*/
+bool WebServer::init_affinity(const char* reactor_cpus, const char* worker_cpus) {
+    if (reactor_cpus && *reactor_cpus && !CpuAffinity::parse(reactor_cpus, reactor_cpus_)) {
+        LOG_ERROR("reactor cpu list error: %s", reactor_cpus);
+        return false;
+    }
+    if (worker_cpus && *worker_cpus && !CpuAffinity::parse(worker_cpus, worker_cpus_)) {
+        LOG_ERROR("worker cpu list error: %s", worker_cpus);
+        return false;
+    }
+    if (!reactor_cpus_.empty() && worker_cpus_.empty()) {
+        CpuAffinity::node_cpus(CpuAffinity::node_of(reactor_cpus_[0]), worker_cpus_);
+    }
+    return true;
+}
+
+/**
+ * 工作线程启动时调用，在工作线程中执行
+*/
+void WebServer::pin_worker(int index) {
+    if (worker_cpus_.empty()) return;
+    int cpu = worker_cpus_[index % worker_cpus_.size()];
+    if (CpuAffinity::pin(cpu)) {
+        CpuAffinity::prefer_local_memory();
+    }
+    else {
+        LOG_WARN("pin worker %d to cpu %d error!", index, cpu);
+    }
+}
+
 /**
  * 设置监听连接事件和读写事件的触发模式
 */
@@ -83,12 +287,33 @@ void WebServer::init_event_mode(int trig_mode) {
 */
 void WebServer::start() {
     int timeout = -1;
+    //连接对象和读写缓冲区在事件循环中创建，先绑核再分配，内存落在本节点
+    if (!reactor_cpus_.empty()) {
+        if (CpuAffinity::pin(reactor_cpus_)) {
+            CpuAffinity::prefer_local_memory();
+        }
+        else {
+            LOG_WARN("pin reactor to cpu [%s] error!", CpuAffinity::to_string(reactor_cpus_).c_str());
+        }
+    }
     if (!is_close_) LOG_INFO("========== WebServer start ==========");
     while (!is_close_) {
 
         //初始定时值-1，后续为定时器中时间最短的定时器
         if (timeout_ms_ > 0) timeout = timer_->get_next_tick();
+        //优雅退出期间定期检查连接是否都已关闭
+        if (is_draining_) {
+            check_drain();
+            if (is_close_) break;
+            if (timeout < 0 || timeout > DRAIN_CHECK_MS) timeout = DRAIN_CHECK_MS;
+        }
+        //定期输出运行指标
+        if (stats_interval_ms_ > 0) {
+            int stats_ms = check_stats();
+            if (timeout < 0 || timeout > stats_ms) timeout = stats_ms;
+        }
         int event_cnt = epoller_->wait(timeout);
+        auto busy_begin = std::chrono::steady_clock::now();
 
         //处理触发的事件
         for (int i = 0; i < event_cnt; ++i) {
@@ -99,6 +324,15 @@ void WebServer::start() {
             if (fd == listen_fd_) {//连接事件
                 deal_listen();
             }
+            else if (fd == auth_event_fd_) {//登录注册校验完成
+                deal_auth_done();
+            }
+            else if (fd == signal_fd_) {
+                deal_signal();
+            }
+            else if (fd == restart_fd_) {//热重启的新进程就绪或失败
+                deal_restart_ready();
+            }
             else if (events & (EPOLLRDHUP|EPOLLHUP|EPOLLERR)) {
                 assert(users_.count(fd) > 0);
                 close_connection(&users_[fd]);
@@ -115,9 +349,319 @@ void WebServer::start() {
                 LOG_ERROR("Unexpected event");
             }
         }
+        //事件循环延迟：处理这一批事件的耗时，越长新事件等待越久
+        if (event_cnt > 0) {
+            admission_.record_loop(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - busy_begin).count());
+        }
     }
 }
 
+/**
+ * 屏蔽退出和热重启信号，改由signalfd在事件循环中处理
+ * 对端关闭后继续写socket会产生SIGPIPE，默认动作是终止进程，忽略它，由write返回EPIPE
+*/
+bool WebServer::init_signal() {
+    signal(SIGPIPE, SIG_IGN);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGUSR2);
+    sigaddset(&mask, SIGHUP);
+    if (pthread_sigmask(SIG_BLOCK, &mask, nullptr) != 0) {
+        LOG_ERROR("block signals error!");
+        return false;
+    }
+    signal_fd_ = signalfd(-1, &mask, SFD_NONBLOCK|SFD_CLOEXEC);
+    if (signal_fd_ < 0 || !epoller_->add_fd(signal_fd_, EPOLLIN)) {
+        LOG_ERROR("create signalfd error!");
+        return false;
+    }
+    return true;
+}
+
+void WebServer::deal_signal() {
+    struct signalfd_siginfo info;
+    while (::read(signal_fd_, &info, sizeof(info)) == sizeof(info)) {
+        switch (info.ssi_signo) {
+            case SIGTERM:
+            case SIGINT:
+                LOG_INFO("receive signal %d, shutting down", static_cast<int>(info.ssi_signo));
+                begin_drain();
+                break;
+            case SIGUSR2:
+                hot_restart();
+                break;
+            case SIGHUP:
+                reload_config();
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/**
+ * 开始优雅退出
+ * 关闭监听socket，之后的响应都带Connection: close，发送完就关闭连接
+ * 没有处理中请求的连接只关闭读端：在等待请求的连接马上收到可读事件并被关闭，
+ * 正被工作线程读取的连接读到EOF后也会关闭；不在这里直接close，fd此时可能正被工作线程使用
+*/
+void WebServer::begin_drain() {
+    if (is_draining_) return;
+    is_draining_ = true;
+    HttpConn::is_draining = true;
+    drain_deadline_ = std::chrono::steady_clock::now() + MS(drain_timeout_ms_);
+
+    if (listen_fd_ >= 0) {
+        epoller_->del_fd(listen_fd_);
+        close(listen_fd_);
+        listen_fd_ = -1;
+    }
+    if (idle_fd_ >= 0) {
+        close(idle_fd_);
+        idle_fd_ = -1;
+    }
+
+    int idle = 0;
+    for (auto& item : users_) {
+        HttpConn& client = item.second;
+        if (client.is_closed() || client.is_inflight()) continue;
+        shutdown(client.get_fd(), SHUT_RD);
+        idle++;
+    }
+    LOG_INFO("draining: %d connections, %d idle, %d requests in flight, timeout %dms",
+            static_cast<int>(HttpConn::user_count), idle,
+            static_cast<int>(HttpConn::inflight_count), drain_timeout_ms_);
+}
+
+/**
+ * 所有连接关闭后退出事件循环，超时后shutdown剩下的连接再退出
+*/
+void WebServer::check_drain() {
+    if (HttpConn::user_count > 0 || auth_pending_ > 0) {
+        if (std::chrono::steady_clock::now() < drain_deadline_) return;
+        //工作线程可能正在读写这些连接，这里只shutdown让它们的读写出错返回，fd在析构中等工作线程停止后再关闭
+        LOG_WARN("drain timeout, shutdown %d connections", static_cast<int>(HttpConn::user_count));
+        for (auto& item : users_) {
+            if (!item.second.is_closed()) shutdown(item.second.get_fd(), SHUT_RDWR);
+        }
+    }
+    LOG_INFO("========== WebServer stop ==========");
+    is_close_ = true;
+}
+
+/**
+ * 热重启
+ * fork后exec同一个程序(可以是刚替换的新版本)，监听socket和就绪通知管道通过fd继承传给新进程，
+ * fd编号写在环境变量中；新进程预加载完文件缓存后通知，本进程再停止accept并优雅退出，
+ * 两个进程交接期间都在accept同一个socket，不会拒绝连接
+ * fork之后子进程只能调用异步信号安全的函数，参数和环境变量都在fork之前准备好
+*/
+void WebServer::hot_restart() {
+    if (is_draining_ || restart_pid_ > 0 || listen_fd_ < 0) {
+        LOG_WARN("hot restart ignored: %s", is_draining_ ? "draining" : "restart in progress");
+        return;
+    }
+
+    //命令行参数
+    std::vector<std::string> args;
+    int cmd_fd = open("/proc/self/cmdline", O_RDONLY|O_CLOEXEC);
+    if (cmd_fd >= 0) {
+        std::string cmdline;
+        char buf[4096];
+        ssize_t len;
+        while ((len = ::read(cmd_fd, buf, sizeof(buf))) > 0) cmdline.append(buf, len);
+        close(cmd_fd);
+        size_t pos = 0;
+        while (pos < cmdline.size()) {
+            size_t end = cmdline.find('\0', pos);
+            if (end == std::string::npos) end = cmdline.size();
+            args.push_back(cmdline.substr(pos, end - pos));
+            pos = end + 1;
+        }
+    }
+    if (args.empty()) {
+        LOG_ERROR("hot restart: read cmdline error!");
+        return;
+    }
+    //argv[0]不含路径时用当前程序的路径，程序文件被替换后readlink的结果带" (deleted)"后缀
+    std::string path = args[0];
+    if (path.find('/') == std::string::npos) {
+        char exe[PATH_MAX];
+        ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+        if (len <= 0) {
+            LOG_ERROR("hot restart: readlink error!");
+            return;
+        }
+        path.assign(exe, len);
+        const std::string deleted = " (deleted)";
+        if (path.size() > deleted.size() && path.compare(path.size() - deleted.size(), deleted.size(), deleted) == 0) {
+            path.resize(path.size() - deleted.size());
+        }
+    }
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        LOG_ERROR("hot restart: pipe error!");
+        return;
+    }
+
+    //环境变量，去掉继承来的旧值
+    std::vector<std::string> envs;
+    size_t listen_len = strlen(LISTEN_FD_ENV), ready_len = strlen(READY_FD_ENV);
+    for (char** env = environ; *env; env++) {
+        if ((strncmp(*env, LISTEN_FD_ENV, listen_len) == 0 && (*env)[listen_len] == '=')
+            || (strncmp(*env, READY_FD_ENV, ready_len) == 0 && (*env)[ready_len] == '=')) continue;
+        envs.push_back(*env);
+    }
+    envs.push_back(std::string(LISTEN_FD_ENV) + "=" + std::to_string(listen_fd_));
+    envs.push_back(std::string(READY_FD_ENV) + "=" + std::to_string(fds[1]));
+
+    std::vector<char*> argv, envp;
+    for (std::string& arg : args) argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+    for (std::string& env : envs) envp.push_back(&env[0]);
+    envp.push_back(nullptr);
+
+    struct rlimit limit;
+    int max_fd = (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+                    ? static_cast<int>(limit.rlim_cur) : MAX_FD;
+    int listen_fd = listen_fd_, ready_fd = fds[1];
+    sigset_t empty;
+    sigemptyset(&empty);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        LOG_ERROR("hot restart: fork error!");
+        close(fds[0]);
+        close(fds[1]);
+        return;
+    }
+    if (pid == 0) {
+        //只保留监听socket和通知管道，客户端连接等其他fd都不能留在新进程中，否则旧进程关闭连接时对端收不到FIN
+        for (int fd = 3; fd < max_fd; fd++) {
+            if (fd != listen_fd && fd != ready_fd) close(fd);
+        }
+        fcntl(listen_fd, F_SETFD, 0);
+        fcntl(ready_fd, F_SETFD, 0);
+        sigprocmask(SIG_SETMASK, &empty, nullptr);
+        execve(path.c_str(), argv.data(), envp.data());
+        _exit(127);
+    }
+
+    close(fds[1]);
+    restart_fd_ = fds[0];
+    restart_pid_ = pid;
+    epoller_->add_fd(restart_fd_, EPOLLIN);
+    LOG_INFO("hot restart: start %s, pid %d", path.c_str(), static_cast<int>(pid));
+}
+
+/**
+ * 新进程写入就绪通知后本进程开始优雅退出；读到EOF说明新进程没有就绪就退出了，本进程继续服务
+*/
+void WebServer::deal_restart_ready() {
+    char ready = 0;
+    ssize_t len = ::read(restart_fd_, &ready, 1);
+    if (len < 0 && errno == EAGAIN) return;
+
+    epoller_->del_fd(restart_fd_);
+    close(restart_fd_);
+    restart_fd_ = -1;
+    if (len == 1) {
+        LOG_INFO("hot restart: pid %d ready, handing over", static_cast<int>(restart_pid_));
+        begin_drain();
+    }
+    else {
+        int status = 0;
+        waitpid(restart_pid_, &status, 0);
+        LOG_ERROR("hot restart: pid %d failed, status %d, keep serving", static_cast<int>(restart_pid_), status);
+        restart_pid_ = -1;
+    }
+}
+
+/**
+ * 热重启启动的进程初始化完成后通知旧进程
+*/
+void WebServer::notify_ready() {
+    const char* env = getenv(READY_FD_ENV);
+    if (!env) return;
+    int fd = atoi(env);
+    unsetenv(READY_FD_ENV);
+    if (fd <= 2) return;
+    char ready = 1;
+    if (::write(fd, &ready, 1) != 1) {
+        LOG_WARN("notify parent ready error!");
+    }
+    close(fd);
+}
+
+/**
+ * 应用可重载的配置，启动时和重载时在事件循环线程中调用
+ * 空闲超时在连接下次活动时按新值设置，已在定时器中的不变
+*/
+void WebServer::apply_config() {
+    timeout_ms_ = config_.get_int("timeout_ms");
+    min_timeout_ms_ = std::min(config_.get_int("min_timeout_ms"), config_.get_int("timeout_ms"));
+    drain_timeout_ms_ = config_.get_int("drain_timeout_ms");
+    stats_interval_ms_ = config_.get_int("stats_interval_ms");
+    next_stats_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(stats_interval_ms_);
+    HttpConn::keepalive_max = config_.get_int("keepalive_max");
+    HttpConn::keepalive_timeout_ms = std::max(timeout_ms_, 0);
+
+    AdmissionControl::Limits limits;
+    limits.max_conn = config_.get_int("max_conn");
+    limits.max_queue = config_.get_int("max_queue");
+    limits.max_inflight = config_.get_int("max_inflight");
+    limits.max_loop_lag_ms = config_.get_int("max_loop_lag_ms");
+    limits.retry_after_s = config_.get_int("retry_after_s");
+    set_admission(limits);
+
+    FileCache::instance()->init(config_.get_int("cache_max_bytes"), config_.get_int("cache_max_file_size"));
+    if (Log::instance()->is_open()) Log::instance()->set_level(config_.get_int("log_level"));
+}
+
+/**
+ * SIGHUP重新读取配置文件和环境变量
+ * 配置有错误时保持原配置；不可重载的配置改变了只提示，需要重启才生效
+ * 超时在0和非0之间切换会改变连接是否有定时器，不能重载
+*/
+void WebServer::reload_config() {
+    Config config = config_;
+    std::vector<std::string> changed;
+    if (!config.reload(&changed)) {
+        LOG_ERROR("reload config error: %s, keep current config", config.get_error().c_str());
+        return;
+    }
+    if ((config.get_int("timeout_ms") > 0) != (config_.get_int("timeout_ms") > 0)) {
+        LOG_ERROR("reload config error: timeout_ms can not switch between 0 and non-zero, keep current config");
+        return;
+    }
+    for (const std::string& name : changed) {
+        if (Config::is_reloadable(name)) {
+            LOG_INFO("config %s: %s -> %s", name.c_str(),
+                    config_.get_string(name.c_str()).c_str(), config.get_string(name.c_str()).c_str());
+        }
+        else {
+            LOG_WARN("config %s changed, restart required", name.c_str());
+        }
+    }
+    config_ = config;
+    apply_config();
+    LOG_INFO("config reloaded, %d changed", static_cast<int>(changed.size()));
+}
+
+/**
+ * 设置准入控制的阈值
+*/
+void WebServer::set_admission(const AdmissionControl::Limits& limits) {
+    AdmissionControl::Limits l = limits;
+    if (l.max_conn <= 0 || l.max_conn > max_conn_) l.max_conn = max_conn_;
+    admission_.set_limits(l);
+}
+
 /**
  * 添加新的连接
 */
@@ -127,7 +671,7 @@ void WebServer::add_client(int fd, sockaddr_in addr) {
 
     if (timeout_ms_ > 0) {
         //添加定时事件
-        timer_->add(fd, timeout_ms_, std::bind(&WebServer::close_connection, this, &users_[fd]));
+        timer_->add(fd, idle_timeout(), std::bind(&WebServer::close_connection, this, &users_[fd]));
     }
 
     epoller_->add_fd(fd, conn_event_|EPOLLIN);
@@ -139,17 +683,50 @@ void WebServer::add_client(int fd, sockaddr_in addr) {
 
 
 /**
- * 给连接发送忙消息然后断开连接
+ * 给连接发送错误响应然后断开连接
+ * 新连接的发送缓冲区是空的，非阻塞发送一次即可，发不完也不等待
 */
-void WebServer::send_error(int fd, const char* info) {
+void WebServer::send_error(int fd, const std::string& response) {
     assert(fd > 0);
-    int ret = send(fd, info, strlen(info), 0);
+    int ret = send(fd, response.data(), response.size(), MSG_DONTWAIT|MSG_NOSIGNAL);
     if (ret < 0) {
-        LOG_WARN("send error to client[%d] error!", fd);
+        LOG_DEBUG("send error to client[%d] error!", fd);
     }
     close(fd);
 }
 
+/**
+ * 拒绝新连接：返回503并关闭
+ * 过载时拒绝会很频繁，只记录第一次和之后每1024次
+*/
+void WebServer::shed_connection(int fd, AdmissionControl::REASON reason) {
+    send_error(fd, admission_.get_busy_response());
+    uint64_t shed = admission_.get_shed_count();
+    if ((shed & 1023) == 1) {
+        LOG_WARN("server busy (%s), shed %llu connections, user_count: %d, inflight: %d, loop lag: %lldus",
+                AdmissionControl::reason_name(reason), static_cast<unsigned long long>(shed),
+                static_cast<int>(HttpConn::user_count), static_cast<int>(HttpConn::inflight_count),
+                static_cast<long long>(admission_.get_loop_lag_us()));
+    }
+}
+
+/**
+ * 文件描述符耗尽时accept会一直失败，连接留在全连接队列中，ET模式下不会再通知
+ * 关闭预留的fd腾出一个位置，取出一个连接回复503后再重新预留
+*/
+bool WebServer::accept_when_fd_exhausted() {
+    if (idle_fd_ < 0) return false;
+    close(idle_fd_);
+    idle_fd_ = -1;
+    int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd >= 0) {
+        admission_.shed(AdmissionControl::SHED_FD);
+        shed_connection(fd, AdmissionControl::SHED_FD);
+    }
+    idle_fd_ = open("/dev/null", O_RDONLY|O_CLOEXEC);
+    return fd >= 0;
+}
+
 /**
  * 断开连接
  * 取消epoll监听
@@ -169,16 +746,21 @@ void WebServer::deal_listen() {
     struct sockaddr_in addr;
     socklen_t addrlen = sizeof(addr);
     do {
+        addrlen = sizeof(addr);
         int fd = accept(listen_fd_, (struct sockaddr *)&addr, &addrlen);
-        if (fd <= 0) return;
-        else if (HttpConn::user_count >= MAX_FD) {
-            send_error(fd, "server busy!");
-            LOG_WARN("server busy, client is full!");
-            close(fd);//连接过多关闭，增加关闭连接
+        if (fd < 0) {
+            if ((errno == EMFILE || errno == ENFILE) && accept_when_fd_exhausted()) continue;
             return;
         }
+        //过载时拒绝新连接，已有连接继续处理
+        AdmissionControl::REASON reason;
+        if (!admission_.admit(HttpConn::user_count, threadpool_->get_queue_size(),
+                              HttpConn::inflight_count, &reason)) {
+            shed_connection(fd, reason);
+            continue;
+        }
         add_client(fd, addr);
-    } while (conn_event_ & EPOLLET);
+    } while (listen_event_ & EPOLLET);
     //ET模式读到空为止,因为多个连接事件一起到达仅触发一次
 }
 
@@ -225,16 +807,16 @@ void WebServer::on_write(HttpConn* client) {
     int write_error = 0;
     ret = client->write(&write_error);
     if (client->to_write_bytes() == 0) {//数据全部发送完毕且开启长连接则继续处理请求
+        client->log_access();
+        client->end_request();
         if (client->is_keepalive()) {
             on_process(client);
             return;
         }
     }
-    else if (ret < 0) {//或者数据一次性发送不完
-        if (write_error == EAGAIN) {
-            epoller_->mod_fd(client->get_fd(), conn_event_|EPOLLOUT);
-            return;
-        }
+    else if (ret > 0 || write_error == EAGAIN) {//数据一次发送不完，等待下一次可写
+        epoller_->mod_fd(client->get_fd(), conn_event_|EPOLLOUT);
+        return;
     }
     //否则关闭连接
     close_connection(client);
@@ -245,6 +827,10 @@ void WebServer::on_write(HttpConn* client) {
 */
 void WebServer::on_process(HttpConn* client) {
     if (client->process()) {
+        if (client->is_auth_pending()) {//挂起连接，不注册任何事件直到校验完成
+            submit_auth(client);
+            return;
+        }
         epoller_->mod_fd(client->get_fd(),  conn_event_|EPOLLOUT);//设置写监听
     }
     else {
@@ -252,11 +838,128 @@ void WebServer::on_process(HttpConn* client) {
     }
 }
 
+/**
+ * 创建数据库线程、哈希线程和通知事件循环用的eventfd
+ * conn_pool_num为0时不创建数据库线程
+*/
+bool WebServer::init_auth(int conn_pool_num) {
+    auth_event_fd_ = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if (auth_event_fd_ < 0) {
+        LOG_ERROR("create auth eventfd error!");
+        return false;
+    }
+    if (!epoller_->add_fd(auth_event_fd_, EPOLLIN)) {
+        LOG_ERROR("add auth eventfd error!");
+        return false;
+    }
+    //每个数据库线程同时最多占用一个连接，取连接不会阻塞
+    if (conn_pool_num > 0) sqlpool_.reset(new ThreadPool(conn_pool_num));
+    hasher_.reset(new PasswordHasher(config_.get_int("hash_threads"), config_.get_int("hash_queue_size"),
+                                     config_.get_int("hash_cost")));
+    auth_.reset(new Authenticator(user_store_.get(), sqlpool_.get(), hasher_.get()));
+    return true;
+}
+
+/**
+ * 把登录注册请求交给校验器
+ * 用户名密码拷贝进任务，数据库线程和哈希线程不访问连接对象
+ * 排队过多时直接返回503
+*/
+void WebServer::submit_auth(HttpConn* client) {
+    std::string name, password;
+    bool is_login;
+    client->get_auth(name, password, is_login);
+
+    if (++auth_pending_ > max_auth_pending_) {
+        auth_pending_--;
+        LOG_WARN("auth queue full, reject client[%d]", client->get_fd());
+        on_auth_done(client, Authenticator::AUTH_BUSY);
+        return;
+    }
+
+    int fd = client->get_fd();
+    uint64_t seq = client->get_conn_seq();
+    auth_->verify(name, password, is_login, [this, fd, seq](Authenticator::RESULT result) {
+        post_auth_done(fd, seq, result);
+    });
+}
+
+/**
+ * 投递校验结果并唤醒事件循环，可能在任意线程中调用
+*/
+void WebServer::post_auth_done(int fd, uint64_t seq, Authenticator::RESULT result) {
+    {
+        std::lock_guard<std::mutex> lock(auth_mtx_);
+        auth_done_.push_back({fd, seq, result});
+    }
+    uint64_t one = 1;
+    ssize_t ret = ::write(auth_event_fd_, &one, sizeof(one));
+    (void)ret;
+}
+
+/**
+ * 事件循环取出校验结果，连接仍有效则交给工作线程生成响应
+ * 连接挂起期间只有事件循环中的定时器可能关闭它，因此这里的检查没有竞争
+*/
+void WebServer::deal_auth_done() {
+    uint64_t count;
+    ssize_t ret = ::read(auth_event_fd_, &count, sizeof(count));
+    (void)ret;
+
+    std::vector<AuthDone> done;
+    {
+        std::lock_guard<std::mutex> lock(auth_mtx_);
+        done.swap(auth_done_);
+    }
+    auth_pending_ -= static_cast<int>(done.size());
+
+    for (const AuthDone& item : done) {
+        auto it = users_.find(item.fd);
+        if (it == users_.end() || it->second.is_closed() || it->second.get_conn_seq() != item.seq) {
+            LOG_DEBUG("client[%d] closed before auth done", item.fd);
+            continue;
+        }
+        HttpConn* client = &it->second;
+        extent_time(client);
+        threadpool_->add_task(std::bind(&WebServer::on_auth_done, this, client, item.result));
+    }
+}
+
+/**
+ * 按校验结果生成响应并注册写监听
+*/
+void WebServer::on_auth_done(HttpConn* client, Authenticator::RESULT result) {
+    client->finish_auth(result);
+    epoller_->mod_fd(client->get_fd(), conn_event_|EPOLLOUT);
+}
+
 /**
  * 更新连接的定时器
 */
 void WebServer::extent_time(HttpConn* client) {
-    if (timeout_ms_ > 0) timer_->adjust(client->get_fd(), timeout_ms_);
+    if (timeout_ms_ > 0) timer_->adjust(client->get_fd(), idle_timeout());
+}
+
+/**
+ * 按连接数计算空闲超时
+ * 连接数超过PRESSURE_LOW后从timeout_ms_线性缩短到min_timeout_ms_，尽快回收空闲连接占用的fd
+ * 结果同步给HttpConn，写进Keep-Alive头
+*/
+int WebServer::idle_timeout() {
+    int users = HttpConn::user_count;
+    int low = static_cast<int>(static_cast<int64_t>(max_conn_) * PRESSURE_LOW / 100);
+    int high = static_cast<int>(static_cast<int64_t>(max_conn_) * PRESSURE_HIGH / 100);
+    int timeout = timeout_ms_;
+    if (users >= high) {
+        timeout = min_timeout_ms_;
+    }
+    else if (users > low) {
+        timeout = timeout_ms_ - static_cast<int>(static_cast<int64_t>(timeout_ms_ - min_timeout_ms_)
+                                                * (users - low) / (high - low));
+    }
+    if (timeout <= 0) timeout = 1;
+    HttpConn::keepalive_timeout_ms = timeout;
+    return timeout;
 }
 
 /**
@@ -270,6 +973,14 @@ bool WebServer::init_socket() {
         return false;
     }
 
+    //热重启启动的进程直接使用旧进程的监听socket
+    const char* inherited = getenv(LISTEN_FD_ENV);
+    if (inherited) {
+        int fd = atoi(inherited);
+        unsetenv(LISTEN_FD_ENV);
+        return inherit_socket(fd);
+    }
+
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port_);
     addr.sin_addr.s_addr = htonl(INADDR_ANY);
@@ -323,7 +1034,7 @@ bool WebServer::init_socket() {
     }
 
     //监听端口
-    ret = listen(listen_fd_, 6);
+    ret = listen(listen_fd_, LISTEN_BACKLOG);
     if (ret < 0) {
         close(listen_fd_);
         LOG_ERROR("listEN error!");
@@ -337,6 +1048,33 @@ bool WebServer::init_socket() {
     return true;
 }
 
+/**
+ * 接手继承来的监听socket，检查它确实在监听配置的端口
+*/
+bool WebServer::inherit_socket(int fd) {
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    int listening = 0;
+    socklen_t optlen = sizeof(listening);
+    if (fd <= 2 || getsockname(fd, (struct sockaddr *)&addr, &addrlen) < 0
+        || addr.sin_family != AF_INET || ntohs(addr.sin_port) != port_
+        || getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &optlen) < 0 || !listening) {
+        LOG_ERROR("inherited listen fd %d error", fd);
+        return false;
+    }
+    listen_fd_ = fd;
+    fcntl(listen_fd_, F_SETFD, FD_CLOEXEC);
+    if (!epoller_->add_fd(listen_fd_, listen_event_|EPOLLIN)) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+        LOG_ERROR("add listen fd error!");
+        return false;
+    }
+    set_fd_nonblock(listen_fd_);
+    LOG_INFO("server port %d, inherited listen fd %d", port_, listen_fd_);
+    return true;
+}
+
 /**
  * 设置fd非阻塞
 */
@@ -6,52 +6,127 @@
 #define __WEBSERVER_H_
 
 #include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <limits.h>
 #include <arpa/inet.h>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <vector>
 #include <functional>
 #include <unordered_map>
 #include "../timer/heaptimer.h"
 #include "../pool/threadpool.h"
 #include "../event/epoller.h"
 #include "../http/httpconn.h"
+#include "../pool/mysqluserstore.h"
+#include "../pool/localuserstore.h"
+#include "../pool/passwordhasher.h"
+#include "../pool/authenticator.h"
+#include "../pool/cpuaffinity.h"
+#include "admission.h"
+#include "../config/config.h"
 
 
 class WebServer {
 public:
-    WebServer(int port, int trig_mode, int timeout_ms, bool opt_linger, 
-              int thread_num, bool open_log, int log_level, int log_queue_size);
+    explicit WebServer(const Config& config);
     ~WebServer();
     void start();
+    void set_admission(const AdmissionControl::Limits& limits);//在事件循环线程中调用，max_conn为0时使用max_conn_
 
 private:    
     bool init_socket();
+    bool inherit_socket(int fd);
+    bool init_signal();
+    void notify_ready();
     void init_event_mode(int trig_mode);
+    bool init_affinity(const char* reactor_cpus, const char* worker_cpus);
+    void pin_worker(int index);
     void add_client(int fd, sockaddr_in addr);
 
     void deal_listen();
     void deal_write(HttpConn* client);
     void deal_read(HttpConn* client);
 
-    void send_error(int fd, const char* info);
+    void send_error(int fd, const std::string& response);
+    void shed_connection(int fd, AdmissionControl::REASON reason);
+    bool accept_when_fd_exhausted();
     void extent_time(HttpConn* client);
+    int idle_timeout();
     void close_connection(HttpConn* client);
 
+    //SIGTERM、SIGINT优雅退出：停止接受连接，发送完处理中的响应，关闭空闲连接
+    //SIGHUP重新加载可重载的配置
+    //SIGUSR2热重启：启动新进程并把监听socket传给它，新进程就绪后本进程优雅退出
+    void deal_signal();
+    void begin_drain();
+    void check_drain();
+    void hot_restart();
+    void deal_restart_ready();
+    //SIGHUP重新加载配置
+    void apply_config();
+    void reload_config();
+    //运行指标
+    void log_stats();
+    int check_stats();
+
     void on_read(HttpConn* client);
     void on_write(HttpConn* client);
     void on_process(HttpConn* client);
 
+    //登录注册的存储访问在数据库线程中进行，密码哈希在哈希线程中进行，结果经eventfd投递回事件循环
+    bool init_auth(int conn_pool_num);
+    void submit_auth(HttpConn* client);
+    void post_auth_done(int fd, uint64_t seq, Authenticator::RESULT result);
+    void deal_auth_done();
+    void on_auth_done(HttpConn* client, Authenticator::RESULT result);
+
     static int set_fd_nonblock(int fd);
 
 private:
     static const int MAX_FD = 65536;
-
+    static const int FD_RESERVE = 64;//文件描述符上限中不用于连接的部分
+    static const int DRAIN_CHECK_MS = 100;
+    static const char* LISTEN_FD_ENV;//热重启时新进程从环境变量中取继承的监听socket
+    static const char* READY_FD_ENV;//新进程初始化完成后写这个fd通知旧进程
+    static const int LISTEN_BACKLOG = 1024;//全连接队列太短时过载的连接会被内核直接丢弃，收不到503
+    static const int PRESSURE_LOW = 50;//连接数超过上限的50%开始缩短空闲超时
+    static const int PRESSURE_HIGH = 90;//超过90%时使用最短空闲超时
+
+    struct AuthDone {
+        int fd;
+        uint64_t seq;//连接序号，连接已关闭或被复用时丢弃结果
+        Authenticator::RESULT result;
+    };
+
+    Config config_;
     int port_;
     bool opt_linger_;//优雅关闭
     int timeout_ms_;
+    int min_timeout_ms_;//连接数接近上限时的最短空闲超时
+    int max_conn_;//MAX_FD和进程文件描述符上限中较小的一个
     bool is_close_;
     int listen_fd_;
+    int idle_fd_;//预留的fd，文件描述符耗尽时关闭它腾出位置接受并拒绝连接
+    int signal_fd_;
+
+    bool is_draining_;
+    int drain_timeout_ms_;
+    std::chrono::steady_clock::time_point drain_deadline_;
+    pid_t restart_pid_;//热重启启动的新进程
+    int restart_fd_;//新进程就绪时可读，新进程初始化失败退出时读到EOF
+    int stats_interval_ms_;//定期输出运行指标的间隔，0为只在退出时输出
+    std::chrono::steady_clock::time_point next_stats_;
     char* src_dir_;
 
+    std::vector<int> reactor_cpus_;//事件循环线程绑定的CPU，为空时不绑定
+    std::vector<int> worker_cpus_;//工作线程按序号轮流绑定其中一个CPU
+
     uint32_t listen_event_;
     uint32_t conn_event_;
 
@@ -59,6 +134,17 @@ private:
     std::unique_ptr<ThreadPool> threadpool_;
     std::unique_ptr<Epoller> epoller_;
     std::unordered_map<int, HttpConn> users_;
+    AdmissionControl admission_;
+
+    std::unique_ptr<UserStore> user_store_;
+    std::unique_ptr<ThreadPool> sqlpool_;//数据库线程，线程数等于连接池大小
+    std::unique_ptr<PasswordHasher> hasher_;
+    std::unique_ptr<Authenticator> auth_;
+    int max_auth_pending_;//排队等待校验的请求上限
+    std::atomic<int> auth_pending_;
+    int auth_event_fd_;//数据库线程通知事件循环
+    std::mutex auth_mtx_;
+    std::vector<AuthDone> auth_done_;
 
 };
 
@@ -17,25 +17,25 @@ HeapTimer::~HeapTimer() {
  * 交换节点
 */
 void HeapTimer::swap_node(size_t i, size_t j) {
-    assert(i >= 0 && i < heap_.size() && j >= 0 && j < heap_.size());
+    assert(i < heap_.size() && j < heap_.size());
     if (i == j) return;
 
     std::swap(heap_[i], heap_[j]);
-    ref_[heap_[i].id] = j;
-    ref_[heap_[j].id] = i;
+    ref_[heap_[i].id] = i;
+    ref_[heap_[j].id] = j;
 }
 
 /**
  * 上虑
+ * 下标是无符号数，到堆顶时必须停下，不能再计算(i-1)/2
 */
 void HeapTimer::siftup(size_t i) {
-    assert(i >= 0 && i < heap_.size());
-    size_t j = (i - 1) / 2;
-    while (j >= 0) {
-        if (heap_[j] < heap_[i]) break;
+    assert(i < heap_.size());
+    while (i > 0) {
+        size_t j = (i - 1) / 2;
+        if (!(heap_[i] < heap_[j])) break;
         swap_node(j, i);
         i = j;
-        j = (i - 1) / 2;
     }
 }
 
@@ -43,14 +43,14 @@ void HeapTimer::siftup(size_t i) {
  * 下滤
 */
 bool HeapTimer::siftdown(size_t index, size_t n) {
-    assert(index >= 0 && index < heap_.size());
-    assert(n >= 0 && n <= heap_.size());
-    size_t i = index, j = index * 2 * 1;
+    assert(index < heap_.size());
+    assert(n <= heap_.size());
+    size_t i = index, j = index * 2 + 1;
     while (j < n) {
         //找出最小的子节点
         if (j+1 < n && heap_[j+1] < heap_[j]) j++;
-        //如果下滤节点小于当前子节点最小值则下滤结束
-        if (heap_[i] < heap_[j]) break;
+        //如果下滤节点不大于当前子节点最小值则下滤结束
+        if (!(heap_[j] < heap_[i])) break;
         swap_node(i, j);
         i = j;
         j = i * 2 + 1;
@@ -63,9 +63,12 @@ bool HeapTimer::siftdown(size_t index, size_t n) {
 */
 void HeapTimer::adjust(int id, int new_expires) {
     assert(!heap_.empty() && ref_.count(id));
-    //更新定时器时间并且下滤，新的定时时间一定大于原本的吗？？？
-    heap_[ref_[id]].expires = Clock::now() + MS(new_expires);
-    siftdown(ref_[id], heap_.size());
+    //空闲超时会随连接数缩短，新的定时时间可能早于原本的，下滤不动时再上滤
+    size_t i = ref_[id];
+    heap_[i].expires = Clock::now() + MS(new_expires);
+    if (!siftdown(i, heap_.size())) {
+        siftup(i);
+    }
 }
 
 /**
@@ -96,7 +99,7 @@ void HeapTimer::add(int id, int expires, TimeoutCallback cb) {
 */
 
 void HeapTimer::del(size_t i) {
-    assert(i >= 0 && i < heap_.size());
+    assert(i < heap_.size());
     //将要删除的节点和最后一个节点交换然后调整堆
     size_t n = heap_.size() - 1;
     if (i < n) {
@@ -114,9 +117,12 @@ void HeapTimer::del(size_t i) {
 */
 void HeapTimer::del_and_do_work(int id) {
     assert(id > 0);
-    int i = ref_[id];
-    heap_[i].cb();
+    auto it = ref_.find(id);
+    if (it == ref_.end()) return;
+    size_t i = it->second;
+    TimeoutCallback cb = heap_[i].cb;
     del(i);
+    cb();
 }
 
 /**
@@ -136,8 +142,10 @@ void HeapTimer::tick() {
         if (std::chrono::duration_cast<MS>(heap_[0].expires - Clock::now()).count() > 0) {
             break;
         }
-        heap_[0].cb();
+        //先出队再回调，回调中可能增删定时器
+        TimeoutCallback cb = heap_[0].cb;
         pop();
+        cb();
     }
 }
 
@@ -154,9 +162,9 @@ void HeapTimer::pop() {
 */
 int HeapTimer::get_next_tick() {
     tick();
-    size_t ret = -1;
+    int ret = -1;
     if (heap_.size()) {
-        ret = std::chrono::duration_cast<MS>(heap_.front().expires - Clock::now()).count();
+        ret = static_cast<int>(std::chrono::duration_cast<MS>(heap_.front().expires - Clock::now()).count());
         if(ret < 0) { ret = 0; }
     }
     return ret;
@@ -0,0 +1,37 @@
+/**
+
+ * @Date    :       2021-01-02
+*/
+
+#ifndef __CHECK_H_
+#define __CHECK_H_
+
+#include <stdio.h>
+
+/**
+ * 行为测试的公共部分
+ * CHECK失败时打印位置并计数，不中断测试；main最后返回check_report()的结果，make check据此判断成败
+*/
+static int check_failed = 0;
+
+#define CHECK_MSG(cond, ...) do { \
+    if (!(cond)) { \
+        printf("%s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        check_failed++; \
+    } \
+} while (0)
+
+#define CHECK(cond) CHECK_MSG(cond, "CHECK(%s) failed", #cond)
+
+static inline int check_report(const char* name) {
+    if (check_failed) {
+        printf("%s: %d checks failed\n", name, check_failed);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
+
+#endif // !__CHECK_H_
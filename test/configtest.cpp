@@ -0,0 +1,196 @@
+/**
+
+ * @Date    :       2021-01-07
+*/
+
+/**
+ * 配置加载的行为测试：默认值、配置文件、环境变量、命令行的优先级，出错信息，SIGHUP重载
+ * 用法：./configtest
+*/
+#include "../code/config/config.h"
+#include "check.h"
+#include <algorithm>
+#include <initializer_list>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static char conf_path[] = "/tmp/configtestXXXXXX";
+
+static void write_conf(const char* text) {
+    FILE* fp = fopen(conf_path, "w");
+    CHECK(fp != nullptr);
+    if (!fp) return;
+    fputs(text, fp);
+    fclose(fp);
+}
+
+static bool load(Config& config, std::initializer_list<const char*> args) {
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>("server"));
+    for (const char* arg : args) argv.push_back(const_cast<char*>(arg));
+    argv.push_back(nullptr);
+    return config.load(static_cast<int>(argv.size()) - 1, argv.data());
+}
+
+static bool has_error(const Config& config, const char* text) {
+    if (config.get_error().find(text) != std::string::npos) return true;
+    printf("error '%s' does not contain '%s'\n", config.get_error().c_str(), text);
+    return false;
+}
+
+static void test_defaults() {
+    Config config;
+    CHECK(load(config, {}));
+    CHECK(config.get_int("port") == 3880);
+    CHECK(config.get_int("timeout_ms") == 60000);
+    CHECK(config.get_bool("open_log"));
+    CHECK(!config.get_bool("opt_linger"));
+    CHECK(config.get_string("log_dir") == "./log");
+    CHECK(config.get_cstr("sql_host") == nullptr);
+    CHECK(Config::is_reloadable("timeout_ms"));
+    CHECK(!Config::is_reloadable("port"));
+    CHECK(!Config::is_reloadable("no_such_option"));
+}
+
+/**
+ * 默认值 < 配置文件 < 环境变量 < 命令行
+*/
+static void test_precedence() {
+    write_conf("# comment\n"
+               "  port = 4000  \n"
+               "thread_num=6\n"
+               "log_dir = /var/log/web server\n"
+               "opt_linger = yes\n"
+               "timeout_ms = 1000\n");
+    setenv("WEBSERVER_THREAD_NUM", "7", 1);
+    setenv("WEBSERVER_TIMEOUT_MS", "2000", 1);
+
+    Config config;
+    CHECK(load(config, {"-c", conf_path, "--timeout-ms=3000", "--keepalive_max", "5"}));
+    CHECK(config.get_int("port") == 4000);//文件
+    CHECK(config.get_string("log_dir") == "/var/log/web server");//值中间的空格保留
+    CHECK(config.get_bool("opt_linger"));
+    CHECK(config.get_string("opt_linger") == "true");//布尔值统一保存
+    CHECK(config.get_int("thread_num") == 7);//环境变量覆盖文件
+    CHECK(config.get_int("timeout_ms") == 3000);//命令行覆盖环境变量，'-'等同'_'
+    CHECK(config.get_int("keepalive_max") == 5);
+    CHECK(config.get_int("min_timeout_ms") == 5000);//默认值
+    CHECK(config.get_path() == conf_path);
+
+    unsetenv("WEBSERVER_THREAD_NUM");
+    unsetenv("WEBSERVER_TIMEOUT_MS");
+
+    //WEBSERVER_CONFIG指定配置文件
+    setenv("WEBSERVER_CONFIG", conf_path, 1);
+    Config env_config;
+    CHECK(load(env_config, {}));
+    CHECK(env_config.get_int("port") == 4000);
+    unsetenv("WEBSERVER_CONFIG");
+}
+
+static void test_errors() {
+    {
+        Config config;
+        CHECK(!load(config, {"--no_such_option=1"}));
+        CHECK(has_error(config, "command line: unknown option 'no_such_option'"));
+    }
+    {
+        Config config;
+        CHECK(!load(config, {"--port=abc"}));
+        CHECK(has_error(config, "'port' needs an integer"));
+    }
+    //超出范围的整数
+    for (const char* arg : {"--thread_num=0", "--port=70000", "--hash_cost=99", "--log_level=9", "--timeout_ms=-1"}) {
+        Config config;
+        CHECK(!load(config, {arg}));
+        CHECK(has_error(config, "must be in ["));
+    }
+    {
+        Config config;
+        CHECK(!load(config, {"--opt_linger=maybe"}));
+        CHECK(has_error(config, "'opt_linger' needs true or false"));
+    }
+    {
+        Config config;
+        CHECK(!load(config, {"--port"}));
+        CHECK(has_error(config, "missing value for '--port'"));
+    }
+    {
+        Config config;
+        CHECK(!load(config, {"port=1"}));
+        CHECK(has_error(config, "unexpected argument 'port=1'"));
+    }
+    {
+        Config config;
+        CHECK(!load(config, {"-c", "/tmp/configtest-does-not-exist"}));
+        CHECK(has_error(config, "open config file"));
+    }
+    {
+        Config config;
+        CHECK(!load(config, {"--help"}));
+        CHECK(config.is_help());
+    }
+    //文件中的错误带行号
+    write_conf("port = 4000\n\nthread_num = many\n");
+    {
+        Config config;
+        CHECK(!load(config, {"-c", conf_path}));
+        CHECK(has_error(config, ":3: 'thread_num'"));
+    }
+    write_conf("port 4000\n");
+    {
+        Config config;
+        CHECK(!load(config, {"-c", conf_path}));
+        CHECK(has_error(config, ":1: expected key = value"));
+    }
+    //环境变量中的错误带变量名
+    setenv("WEBSERVER_LOG_LEVEL", "high", 1);
+    {
+        Config config;
+        CHECK(!load(config, {}));
+        CHECK(has_error(config, "WEBSERVER_LOG_LEVEL"));
+    }
+    unsetenv("WEBSERVER_LOG_LEVEL");
+}
+
+/**
+ * 重载重新读取文件和环境变量，命令行的值保留，出错时保持原配置
+*/
+static void test_reload() {
+    write_conf("timeout_ms = 1000\nport = 4000\nlog_level = 1\n");
+    Config config;
+    CHECK(load(config, {"-c", conf_path, "--log_level=2"}));
+
+    std::vector<std::string> changed;
+    CHECK(config.reload(&changed));
+    CHECK(changed.empty());
+
+    write_conf("timeout_ms = 2000\nport = 4001\nlog_level = 3\n");
+    CHECK(config.reload(&changed));
+    std::sort(changed.begin(), changed.end());
+    CHECK(changed == std::vector<std::string>({"port", "timeout_ms"}));
+    CHECK(config.get_int("timeout_ms") == 2000);
+    CHECK(config.get_int("port") == 4001);
+    CHECK(config.get_int("log_level") == 2);//命令行优先
+
+    write_conf("timeout_ms = 3000\nport = x\n");
+    CHECK(!config.reload(&changed));
+    CHECK(has_error(config, "'port'"));
+    CHECK(config.get_int("timeout_ms") == 2000);
+    CHECK(config.get_int("port") == 4001);
+}
+
+int main() {
+    int fd = mkstemp(conf_path);
+    CHECK(fd >= 0);
+    close(fd);
+
+    test_defaults();
+    test_precedence();
+    test_errors();
+    test_reload();
+
+    unlink(conf_path);
+    return check_report("configtest");
+}
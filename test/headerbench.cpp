@@ -0,0 +1,76 @@
+/**
+
+ * @Date    :       2021-01-04
+*/
+
+/**
+ * 响应头序列化性能测试：统计每个响应生成响应头的平均耗时(ns)
+ * legacy为原来用std::string拼接的写法，writer为HeaderWriter，
+ * response为HttpResponse生成缓存中小文件的完整响应(含stat)
+ * 用法：./headerbench [次数] [资源目录]
+*/
+#include "../code/http/httpresponse.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef std::chrono::steady_clock SteadyClock;
+
+static double elapsed_ns(SteadyClock::time_point begin, int count) {
+    return std::chrono::duration<double, std::nano>(SteadyClock::now() - begin).count() / count;
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    std::string src_dir = argc > 2 ? argv[2] : "../resources";
+
+    Buffer buffer;
+    size_t bytes = 0;
+    int code = 200;
+    size_t len = 3148;
+    std::string status = "OK";
+
+    auto begin = SteadyClock::now();
+    for (int i = 0; i < count; i++) {
+        buffer.append("HTTP/1.1 " + std::to_string(code) + " " + status + "\r\n");
+        buffer.append("Connection: ");
+        buffer.append("keep-alive\r\n");
+        buffer.append("keep-alive: max=6, timeout=120\r\n");
+        buffer.append("Content-type: " + std::string("text/html") + "\r\n");
+        buffer.append("Content-length: " + std::to_string(len + i % 7) + "\r\n\r\n");
+        bytes += buffer.get_readable_bytes();
+        buffer.retrieve_all();
+    }
+    double legacy = elapsed_ns(begin, count);
+
+    begin = SteadyClock::now();
+    for (int i = 0; i < count; i++) {
+        HeaderWriter writer(buffer);
+        writer.status_line(code);
+        writer.append("Connection: keep-alive\r\n");
+        writer.append("keep-alive: max=6, timeout=120\r\n");
+        writer.date();
+        writer.header("Content-type", "text/html");
+        writer.header("Content-length", len + i % 7);
+        writer.end();
+        bytes += buffer.get_readable_bytes();
+        buffer.retrieve_all();
+    }
+    double writer = elapsed_ns(begin, count);
+
+    HttpResponse response;
+    int response_count = count / 10 > 0 ? count / 10 : 1;
+    begin = SteadyClock::now();
+    for (int i = 0; i < response_count; i++) {
+        response.init(src_dir, "/index.html", true, 200, HttpRequest::ACCEPT_GZIP);
+        response.make_response(buffer);
+        bytes += buffer.get_readable_bytes();
+        buffer.retrieve_all();
+    }
+    double full = elapsed_ns(begin, response_count);
+    int full_code = response.get_code();
+
+    printf("legacy %.1f ns/op, writer %.1f ns/op, response %.1f ns/op (code %d), bytes: %zu\n",
+            legacy, writer, full, full_code, bytes);
+    return 0;
+}
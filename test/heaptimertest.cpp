@@ -0,0 +1,103 @@
+/**
+
+ * @Date    :       2021-01-04
+*/
+
+/**
+ * 定时器堆的行为测试：超时按到期时间先后触发，调整、删除后堆仍然有序，回调中可以增删定时器
+ * 到期时间用adjust设为过去的时刻，不需要真正等待
+ * 用法：./heaptimertest [定时器数]
+*/
+#include "../code/timer/heaptimer.h"
+#include "check.h"
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const int STEP_MS = 10;//相邻两个到期时间的间隔，远大于设置所有定时器的耗时
+
+/**
+ * 定时器i到期于(n-order[i])*STEP_MS毫秒前，按order从小到大触发
+*/
+static void test_order(int n, std::mt19937& rng) {
+    HeapTimer timer;
+    std::vector<int> order(n + 1), fired;
+    for (int i = 1; i <= n; i++) order[i] = i;
+    std::shuffle(order.begin() + 1, order.end(), rng);
+
+    //先都设为很久以后，再逐个提前，提前时要上滤
+    for (int i = 1; i <= n; i++) {
+        timer.add(i, 1000000 + i, [i, &fired] { fired.push_back(i); });
+    }
+    CHECK(timer.get_next_tick() > 0);
+    for (int i = 1; i <= n; i++) timer.adjust(i, -(n - order[i] + 1) * STEP_MS);
+
+    //删掉一部分，被删除的节点换上来的末尾节点可能要上滤也可能要下滤
+    std::vector<bool> removed(n + 1, false);
+    int removed_count = 0;
+    for (int i = 1; i <= n; i += 7) {
+        timer.del_and_do_work(i);
+        removed[i] = true;
+        removed_count++;
+    }
+    CHECK(static_cast<int>(fired.size()) == removed_count);
+    fired.clear();
+    timer.del_and_do_work(1);//重复删除不触发回调
+    CHECK(fired.empty());
+
+    //把一部分推迟到以后，推迟时要下滤，它们不应被触发
+    int delayed = 0;
+    for (int i = 3; i <= n; i += 5) {
+        if (removed[i]) continue;
+        timer.adjust(i, 1000000);
+        removed[i] = true;
+        delayed++;
+    }
+
+    timer.tick();
+    CHECK(static_cast<int>(fired.size()) == n - removed_count - delayed);
+    for (size_t k = 1; k < fired.size(); k++) {
+        CHECK(order[fired[k-1]] < order[fired[k]]);
+    }
+    for (int id : fired) CHECK(!removed[id]);
+
+    //剩下的都是推迟的，下一次超时在很久以后
+    int next = timer.get_next_tick();
+    CHECK(delayed == 0 || next > 900000);
+}
+
+/**
+ * 回调在出队之后执行，回调中添加或删除定时器不能破坏堆
+*/
+static void test_callback_reentry() {
+    HeapTimer timer;
+    std::vector<int> fired;
+    timer.add(1, 1000, [&] {
+        fired.push_back(1);
+        timer.add(1, 1000, [&] { fired.push_back(10); });//复用同一个id
+        timer.del_and_do_work(2);
+    });
+    timer.add(2, 1000, [&] { fired.push_back(2); });
+    timer.add(3, 1000, [&] { fired.push_back(3); });
+    timer.adjust(1, -30);
+    timer.adjust(3, -20);
+
+    timer.tick();
+    CHECK(fired.size() == 3);
+    CHECK(fired.size() == 3 && fired[0] == 1 && fired[1] == 2 && fired[2] == 3);
+    //id 1的新定时器还在，1秒后到期
+    int next = timer.get_next_tick();
+    CHECK(next > 0 && next <= 1000);
+    timer.del_and_do_work(1);
+    CHECK(fired.back() == 10);
+    CHECK(timer.get_next_tick() == -1);
+}
+
+int main(int argc, char** argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 500;
+    std::mt19937 rng(20210108);
+    for (int size : {1, 2, 3, 8, 31, n}) test_order(size, rng);
+    test_callback_reentry();
+
+    return check_report("heaptimertest");
+}
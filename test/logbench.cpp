@@ -0,0 +1,44 @@
+/**
+
+ * @Date    :       2020-12-26
+*/
+
+/**
+ * 日志性能测试：统计每次LOG_INFO调用的平均耗时(ns)
+ * 用法：./logbench [线程数] [每线程日志条数] [队列容量，0为同步写] [binary]
+*/
+#include "../code/log/log.h"
+#include <chrono>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char** argv) {
+    int thread_num = argc > 1 ? atoi(argv[1]) : 1;
+    int count = argc > 2 ? atoi(argv[2]) : 1000000;
+    int queue_size = argc > 3 ? atoi(argv[3]) : 8192;
+    bool binary = argc > 4 && strcmp(argv[4], "binary") == 0;
+
+    Log::instance()->init(1, "./benchlog", binary ? ".bin" : ".log", queue_size, Log::OVERFLOW_BLOCK,
+                            1, false, binary ? Log::MODE_BINARY : Log::MODE_TEXT);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < thread_num; i++) {
+        threads.emplace_back([i, count] {
+            for (int j = 0; j < count; j++) {
+                LOG_INFO("bench thread %d message %d: %s", i, j, "GET /index.html HTTP/1.1");
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    auto end = std::chrono::steady_clock::now();
+
+    double total = std::chrono::duration<double, std::nano>(end - start).count();
+    printf("threads: %d, calls: %lld, %.1f ns/call, dropped: %llu\n",
+            thread_num, static_cast<long long>(thread_num) * count,
+            total / (static_cast<double>(thread_num) * count),
+            static_cast<unsigned long long>(Log::instance()->get_dropped_count()));
+    return 0;
+}
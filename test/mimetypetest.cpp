@@ -0,0 +1,96 @@
+/**
+
+ * @Date    :       2021-01-03
+*/
+
+/**
+ * MIME类型查询的行为测试：内置类型、大小写、没有后缀的路径、配置文件追加和覆盖
+ * 用法：./mimetypetest
+*/
+#include "../code/http/mimetype.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define CHECK_TYPE(path, expect) do { \
+    std::string_view got = MimeType::lookup(path); \
+    CHECK_MSG(got == (expect), "lookup(\"%s\") = \"%.*s\", expected \"%s\"", \
+              path, static_cast<int>(got.size()), got.data(), expect); \
+} while (0)
+
+static void test_builtin() {
+    static const char* TYPES[][2] = {
+        { "html", "text/html" }, { "htm", "text/html" }, { "xml", "text/xml" },
+        { "xhtml", "application/xhtml+xml" }, { "txt", "text/plain" }, { "css", "text/css" },
+        { "js", "text/javascript" }, { "json", "application/json" }, { "rtf", "application/rtf" },
+        { "pdf", "application/pdf" }, { "doc", "application/msword" }, { "word", "application/msword" },
+        { "png", "image/png" }, { "gif", "image/gif" }, { "jpg", "image/jpeg" }, { "jpeg", "image/jpeg" },
+        { "webp", "image/webp" }, { "svg", "image/svg+xml" }, { "ico", "image/x-icon" },
+        { "woff", "font/woff" }, { "woff2", "font/woff2" }, { "ttf", "font/ttf" }, { "otf", "font/otf" },
+        { "eot", "application/vnd.ms-fontobject" }, { "au", "audio/basic" }, { "mp3", "audio/mpeg" },
+        { "mpeg", "video/mpeg" }, { "mpg", "video/mpeg" }, { "mp4", "video/mp4" },
+        { "webm", "video/webm" }, { "avi", "video/x-msvideo" }, { "gz", "application/x-gzip" },
+        { "tar", "application/x-tar" }, { "wasm", "application/wasm" },
+    };
+    for (const auto& item : TYPES) {
+        std::string path = std::string("/static/file.") + item[0];
+        CHECK_TYPE(path.c_str(), item[1]);
+    }
+
+    //后缀不区分大小写，只看最后一个'.'
+    CHECK_TYPE("/INDEX.HTML", "text/html");
+    CHECK_TYPE("/video.Mp4", "video/mp4");
+    CHECK_TYPE("/archive.tar.gz", "application/x-gzip");
+    //没有后缀、'.'在目录名中、空后缀、过长或未知的后缀
+    CHECK_TYPE("/README", "text/plain");
+    CHECK_TYPE("/v1.2/README", "text/plain");
+    CHECK_TYPE("/file.", "text/plain");
+    CHECK_TYPE("/file.averyverylongext", "text/plain");
+    CHECK_TYPE("/file.xyz", "text/plain");
+    CHECK_TYPE("", "text/plain");
+
+    CHECK(MimeType::is_compressible("text/html"));
+    CHECK(MimeType::is_compressible("image/svg+xml"));
+    CHECK(!MimeType::is_compressible("image/png"));
+    CHECK(!MimeType::is_compressible("video/mp4"));
+}
+
+/**
+ * 配置文件追加新后缀、覆盖内置后缀，忽略注释和不合法的行
+*/
+static void test_load() {
+    char path[] = "/tmp/mimetypetestXXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    static const char CONF[] =
+        "# comment line\n"
+        "md text/markdown\n"
+        ".MP4 video/x-custom\n"
+        "avif image/avif\n"
+        "toolongextension application/x-long\n"
+        "onlyext\n"
+        "\n";
+    CHECK(write(fd, CONF, sizeof(CONF) - 1) == static_cast<ssize_t>(sizeof(CONF) - 1));
+    close(fd);
+
+    CHECK(MimeType::load("/tmp/mimetypetest-does-not-exist") == -1);
+    CHECK(MimeType::load(path) == 3);
+    unlink(path);
+
+    CHECK_TYPE("/notes.md", "text/markdown");
+    CHECK_TYPE("/NOTES.MD", "text/markdown");
+    CHECK_TYPE("/movie.mp4", "video/x-custom");
+    CHECK_TYPE("/photo.avif", "image/avif");
+    CHECK_TYPE("/file.toolongextension", "text/plain");
+    //未配置的后缀仍然查内置表
+    CHECK_TYPE("/style.css", "text/css");
+    CHECK_TYPE("/file.xyz", "text/plain");
+}
+
+int main() {
+    test_builtin();
+    test_load();
+
+    return check_report("mimetypetest");
+}
@@ -0,0 +1,112 @@
+/**
+
+ * @Date    :       2021-01-02
+*/
+
+/**
+ * Range请求的行为测试：在临时目录中生成1000字节的文件，检查各种Range写法的状态码、Content-Range和响应体
+ * 用法：./rangetest
+*/
+#include "../code/http/httpresponse.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const int FILE_SIZE = 1000;
+static std::string dir;
+static std::string content;
+
+struct Result {
+    std::string head;//状态行和响应头
+    std::string body;
+};
+
+static Result request(const std::string& range, const std::string& if_range = "") {
+    HttpResponse response;
+    Buffer buffer;
+    response.init(dir, "/data.bin", false, 200);
+    response.set_range(range, if_range);
+    response.make_response(buffer);
+
+    Result res;
+    res.head.assign(buffer.peek(), buffer.get_readable_bytes());
+    if (response.get_body()) res.body.assign(response.get_body(), response.get_body_len());
+    return res;
+}
+
+static bool has(const Result& res, const char* text) {
+    return res.head.find(text) != std::string::npos;
+}
+
+/**
+ * 期望206，返回[begin, end]
+*/
+static void check_partial(const std::string& range, int begin, int end) {
+    Result res = request(range);
+    char content_range[64], length[64];
+    snprintf(content_range, sizeof(content_range), "Content-Range: bytes %d-%d/%d\r\n", begin, end, FILE_SIZE);
+    snprintf(length, sizeof(length), "Content-length: %d\r\n", end - begin + 1);
+    CHECK_MSG(has(res, "HTTP/1.1 206") && has(res, content_range) && has(res, length)
+              && res.body == content.substr(begin, end - begin + 1),
+              "range '%s' expected %d-%d, got:\n%s", range.c_str(), begin, end, res.head.c_str());
+}
+
+/**
+ * 期望忽略Range，返回整个文件
+*/
+static void check_full(const std::string& range, const std::string& if_range = "") {
+    Result res = request(range, if_range);
+    CHECK_MSG(has(res, "HTTP/1.1 200") && !has(res, "Content-Range") && res.body == content,
+              "range '%s' expected whole file, got:\n%s", range.c_str(), res.head.c_str());
+}
+
+/**
+ * 期望416，响应体是出错页面
+*/
+static void check_unsatisfiable(const std::string& range) {
+    Result res = request(range);
+    CHECK_MSG(has(res, "HTTP/1.1 416") && has(res, "Content-Range: bytes */1000\r\n")
+              && has(res, "Content-type: text/html\r\n"),
+              "range '%s' expected 416, got:\n%s", range.c_str(), res.head.c_str());
+}
+
+int main() {
+    char tmpl[] = "/tmp/rangetestXXXXXX";
+    CHECK(mkdtemp(tmpl) != nullptr);
+    dir = tmpl;
+    for (int i = 0; i < FILE_SIZE; i++) content += static_cast<char>('a' + i % 26);
+    std::string path = dir + "/data.bin";
+    FILE* fp = fopen(path.c_str(), "wb");
+    CHECK(fp && fwrite(content.data(), 1, content.size(), fp) == content.size());
+    if (fp) fclose(fp);
+
+    //a-b，结尾超出文件时截到文件末尾
+    check_partial("bytes=0-99", 0, 99);
+    check_partial("bytes=10-10", 10, 10);
+    check_partial("bytes=990-5000", 990, 999);
+    //a-
+    check_partial("bytes=900-", 900, 999);
+    check_partial("bytes=0-", 0, 999);
+    //-n，最后n个字节，超过文件大小时为整个文件
+    check_partial("bytes=-100", 900, 999);
+    check_partial("bytes=-5000", 0, 999);
+
+    //多个范围、格式不对时忽略Range
+    check_full("bytes=0-99,200-299");
+    check_full("bytes=50-10");
+    check_full("bytes=abc");
+    check_full("bytes=1-2x");
+    check_full("items=0-99");
+    //If-Range与当前版本不符时返回整个文件
+    check_full("bytes=0-99", "\"not-the-etag\"");
+
+    //起点超出文件或后缀长度为0
+    check_unsatisfiable("bytes=1000-");
+    check_unsatisfiable("bytes=5000-6000");
+    check_unsatisfiable("bytes=-0");
+
+    remove(path.c_str());
+    rmdir(dir.c_str());
+    return check_report("rangetest");
+}
@@ -0,0 +1,78 @@
+/**
+
+ * @Date    :       2020-12-30
+*/
+
+/**
+ * 登录注册性能测试：使用本地用户存储，不需要数据库
+ * 统计每次注册和登录校验的平均耗时(ns)，包含bcrypt哈希
+ * 用法：./userbench [用户数] [每个用户登录次数] [cache，开启用户缓存] [bcrypt cost]
+*/
+#include "../code/pool/authenticator.h"
+#include "../code/pool/localuserstore.h"
+#include <chrono>
+#include <future>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * 同步等待一次校验的结果
+*/
+static bool verify(Authenticator& auth, const char* name, bool is_login) {
+    std::promise<Authenticator::RESULT> result;
+    auth.verify(name, "password", is_login, [&result](Authenticator::RESULT r) {
+        result.set_value(r);
+    });
+    return result.get_future().get() == Authenticator::AUTH_OK;
+}
+
+int main(int argc, char** argv) {
+    int user_num = argc > 1 ? atoi(argv[1]) : 1000;
+    int login_num = argc > 2 ? atoi(argv[2]) : 10;
+    bool cache = argc > 3 && strcmp(argv[3], "cache") == 0;
+    int cost = argc > 4 ? atoi(argv[4]) : 4;//bcrypt最小cost，只比较存储和缓存的开销
+
+    const char* path = "./userbench.db";
+    unlink(path);
+    LocalUserStore store;
+    if (!store.open(path)) {
+        fprintf(stderr, "open %s error!\n", path);
+        return 1;
+    }
+    PasswordHasher hasher(1, 16, cost);
+    Authenticator auth(&store, nullptr, &hasher);
+    if (!cache) UserCache::instance()->init(0, 0);
+
+    char name[32];
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < user_num; i++) {
+        snprintf(name, sizeof(name), "user%d", i);
+        if (!verify(auth, name, false)) {
+            fprintf(stderr, "register %s error!\n", name);
+            return 1;
+        }
+    }
+    auto mid = std::chrono::steady_clock::now();
+    int failed = 0;
+    for (int j = 0; j < login_num; j++) {
+        for (int i = 0; i < user_num; i++) {
+            snprintf(name, sizeof(name), "user%d", i);
+            if (!verify(auth, name, true)) failed++;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double reg = std::chrono::duration<double, std::nano>(mid - start).count();
+    double login = std::chrono::duration<double, std::nano>(end - mid).count();
+    printf("users: %d, register %.1f ns/op, login %.1f ns/op, failed: %d\n",
+            user_num, reg / user_num, login / (static_cast<double>(user_num) * login_num), failed);
+    printf("hash tasks: %llu, avg run: %.1f us, avg wait: %.1f us\n",
+            static_cast<unsigned long long>(hasher.get_task_count()),
+            hasher.get_run_time_us() / static_cast<double>(hasher.get_task_count()),
+            hasher.get_wait_time_us() / static_cast<double>(hasher.get_task_count()));
+    store.close();
+    unlink(path);
+    return 0;
+}
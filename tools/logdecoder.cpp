@@ -0,0 +1,132 @@
+/**
+
+ * @Date    :       2020-12-27
+*/
+
+/**
+ * 二进制日志解码工具
+ * 用法：logdecoder 日志文件...
+ * 按文件顺序把二进制日志还原成与文本日志相同的格式输出到标准输出
+*/
+#include "../code/log/logformat.h"
+#include <map>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * 读取整个文件
+*/
+static bool read_file(const char* path, std::vector<char>& data) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return false;
+    char buff[65536];
+    size_t n;
+    while ((n = fread(buff, 1, sizeof(buff), fp)) > 0) {
+        data.insert(data.end(), buff, buff+n);
+    }
+    fclose(fp);
+    return true;
+}
+
+/**
+ * 输出一条日志，格式与文本日志一致
+*/
+static void print_log(const LogFormat* format, int level, int64_t sec, int32_t usec,
+                        const char* args, size_t len) {
+    time_t t = static_cast<time_t>(sec);
+    struct tm tm;
+    localtime_r(&t, &tm);
+
+    std::string line;
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "%04d-%02d-%02d %02d:%02d:%02d.%06d ",
+            tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, usec);
+    line += prefix;
+    line += LogFormat::level_title(level);
+    if (!format) line += "<unknown format>";
+    else if (!format->render(args, len, line)) line += " <truncated>";
+    line += '\n';
+    fwrite(line.data(), 1, line.size(), stdout);
+}
+
+/**
+ * 解码一个二进制日志文件
+*/
+static bool decode(const char* path) {
+    std::vector<char> data;
+    if (!read_file(path, data)) {
+        fprintf(stderr, "open %s error!\n", path);
+        return false;
+    }
+
+    //格式串字典，遇到魔数时清空，因为格式串id只在一个进程内有效
+    std::map<uint32_t, std::string> texts;
+    std::map<uint32_t, LogFormat> formats;
+
+    const char* p = data.data();
+    const char* end = p + data.size();
+    while (p < end) {
+        char kind = *p;
+        if (kind == LogFormat::ENTRY_HEADER) {
+            if (end - p < 1 + static_cast<long>(sizeof(LogFormat::MAGIC))
+                    || memcmp(p+1, LogFormat::MAGIC, sizeof(LogFormat::MAGIC)) != 0) break;
+            formats.clear();
+            texts.clear();
+            p += 1 + sizeof(LogFormat::MAGIC);
+        }
+        else if (kind == LogFormat::ENTRY_FORMAT) {
+            uint32_t id;
+            uint16_t len;
+            if (end - p < 7) break;
+            memcpy(&id, p+1, 4);
+            memcpy(&len, p+5, 2);
+            if (end - p < 7 + len) break;
+            texts[id].assign(p+7, len);
+            formats[id].parse(texts[id].c_str());
+            p += 7 + len;
+        }
+        else if (kind == LogFormat::ENTRY_LOG) {
+            uint16_t len;
+            uint32_t id;
+            int64_t sec;
+            int32_t usec;
+            if (end - p < static_cast<long>(LogFormat::LOG_HEAD_LEN)) break;
+            memcpy(&len, p+1, 2);
+            if (len < LogFormat::LOG_HEAD_LEN || end - p < len) break;
+            memcpy(&id, p+3, 4);
+            int level = p[7];
+            memcpy(&sec, p+8, 8);
+            memcpy(&usec, p+16, 4);
+
+            auto it = formats.find(id);
+            print_log(it == formats.end() ? nullptr : &it->second, level, sec, usec,
+                        p + LogFormat::LOG_HEAD_LEN, len - LogFormat::LOG_HEAD_LEN);
+            p += len;
+        }
+        else {
+            break;
+        }
+    }
+
+    if (p < end) {
+        fprintf(stderr, "%s: corrupt entry at offset %ld\n", path, static_cast<long>(p - data.data()));
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s logfile...\n", argv[0]);
+        return 1;
+    }
+    int ret = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!decode(argv[i])) ret = 1;
+    }
+    return ret;
+}